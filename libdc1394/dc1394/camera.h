@@ -156,6 +156,40 @@ typedef struct __dc1394camera_list_t
 
 typedef struct __dc1394_t dc1394_t;
 
+/**
+ * How register transactions are retried when the camera answers busy or the bus was reset. The wait before each new
+ * attempt doubles from initial_backoff up to max_backoff, and is drawn at random between that value and twice it so
+ * that cameras and threads do not retry in lockstep. Times are in microseconds.
+ */
+typedef struct
+{
+    uint32_t             max_attempts;           /* attempts per transaction, 0 for the default of the platform */
+    uint32_t             initial_backoff;        /* wait before the first retry */
+    uint32_t             max_backoff;            /* longest wait between two attempts */
+    uint32_t             deadline;               /* time after which a transaction is not retried any more, 0 for none */
+} dc1394retry_policy_t;
+
+/**
+ * Number of bins of the histograms of dc1394transaction_stats_t
+ */
+#define DC1394_TRANSACTION_HISTOGRAM_BINS 24
+
+/**
+ * Statistics of the register transactions of a camera. Bin i of the histograms counts the values v with
+ * 2^(i-1) <= v < 2^i, bin 0 counting the zeros. Times are in microseconds.
+ */
+typedef struct
+{
+    uint64_t             transactions;           /* transactions completed, failed or not */
+    uint64_t             failures;               /* transactions that failed */
+    uint64_t             retries;                /* attempts beyond the first one */
+    uint64_t             latency;                /* total time from the first attempt to the end of the transactions */
+    uint32_t             max_latency;            /* longest transaction */
+    uint32_t             latency_histogram[DC1394_TRANSACTION_HISTOGRAM_BINS]; /* transactions by latency */
+    uint32_t             retry_histogram[DC1394_TRANSACTION_HISTOGRAM_BINS];   /* transactions by number of retries */
+    uint64_t             rcodes[16];             /* responses by IEEE 1394 response code (0 is complete, 4 busy) */
+} dc1394transaction_stats_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -203,6 +237,18 @@ dc1394error_t dc1394_read_cycle_timer (dc1394camera_t * camera,
 dc1394error_t dc1394_camera_get_node(dc1394camera_t *camera, uint32_t *node,
         uint32_t * generation);
 
+/**
+ * Sets and gets the policy used to retry the register transactions of a camera.
+ */
+dc1394error_t dc1394_camera_set_retry_policy(dc1394camera_t *camera, const dc1394retry_policy_t *policy);
+dc1394error_t dc1394_camera_get_retry_policy(dc1394camera_t *camera, dc1394retry_policy_t *policy);
+
+/**
+ * Gets the statistics of the register transactions of a camera since it was opened or the statistics were reset.
+ */
+dc1394error_t dc1394_camera_get_transaction_stats(dc1394camera_t *camera, dc1394transaction_stats_t *stats);
+dc1394error_t dc1394_camera_reset_transaction_stats(dc1394camera_t *camera);
+
 
 /***************************************************************************
      Camera functions
@@ -18,11 +18,98 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_POLL_H)
+#define CAPTURE_ASYNC 1
+#endif
+
+#ifdef HAVE_LINUX
+#define _GNU_SOURCE   /* for pthread_attr_setaffinity_np() */
+#endif
+
 #include <stdio.h>
+#ifdef CAPTURE_ASYNC
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 #include "control.h"
 #include "platform.h"
 #include "internal.h"
+#include "utils.h"
+
+#ifdef CAPTURE_ASYNC
+struct _capture_async_t {
+    dc1394camera_t * camera;
+    dc1394capture_callback_t callback;
+    void * user;
+    int fd;
+    int wake_pipe[2];
+    pthread_t thread;
+    pthread_mutex_t mutex;    /* serializes the dispatch of dequeue/enqueue */
+    int free_camera;          /* the callback freed the camera */
+};
+#endif
+
+/* While the capture thread runs, the calls that give buffers back to the
+ * ring must not race with its dequeues. */
+static void
+capture_lock (dc1394camera_priv_t * cpriv)
+{
+#ifdef CAPTURE_ASYNC
+    if (cpriv->async)
+        pthread_mutex_lock (&cpriv->async->mutex);
+#endif
+}
+
+static void
+capture_unlock (dc1394camera_priv_t * cpriv)
+{
+#ifdef CAPTURE_ASYNC
+    if (cpriv->async)
+        pthread_mutex_unlock (&cpriv->async->mutex);
+#endif
+}
+
+/* Gives a frame back to the ring, with the capture lock held if needed.
+ * With automatic ring depth, the ring grows here once the hold times of
+ * the user call for more buffers. */
+static dc1394error_t
+capture_enqueue_frame (dc1394camera_t * camera, dc1394video_frame_t * frame)
+{
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+    const platform_dispatch_t * d = cpriv->platform->dispatch;
+    dc1394error_t err;
+    uint32_t num;
+
+    capture_hold_end (camera, frame);
+    err = d->capture_enqueue (cpriv->pcam, frame);
+    if (err != DC1394_SUCCESS || cpriv->auto_buffers_target <= 0 ||
+            cpriv->capture_buffers >= cpriv->auto_buffers_max)
+        return err;
+
+    num = capture_recommend_buffers (camera, cpriv->auto_buffers_target);
+    if (num > cpriv->auto_buffers_max)
+        num = cpriv->auto_buffers_max;
+    if (num <= cpriv->capture_buffers)
+        return err;
+
+    dc1394_log_debug ("Growing the capture ring from %d to %d buffers",
+            cpriv->capture_buffers, num);
+    if (d->capture_grow (cpriv->pcam, num) == DC1394_SUCCESS)
+        cpriv->capture_buffers = num;
+    else
+        cpriv->auto_buffers_target = 0;
+    return err;
+}
 
 dc1394error_t
 dc1394_capture_setup (dc1394camera_t *camera, uint32_t num_dma_buffers,
@@ -32,6 +119,10 @@ dc1394_capture_setup (dc1394camera_t *camera, uint32_t num_dma_buffers,
     const platform_dispatch_t * d = cpriv->platform->dispatch;
     if (!d->capture_setup)
         return DC1394_FUNCTION_NOT_SUPPORTED;
+    capture_reset_stats (camera);
+    cpriv->capture_buffers = num_dma_buffers;
+    cpriv->capture_flags = flags;
+    cpriv->capture_restartable = 1;
     return d->capture_setup (cpriv->pcam, num_dma_buffers, flags);
 }
 
@@ -42,6 +133,10 @@ dc1394_capture_stop (dc1394camera_t *camera)
     const platform_dispatch_t * d = cpriv->platform->dispatch;
     if (!d->capture_stop)
         return DC1394_FUNCTION_NOT_SUPPORTED;
+    if (cpriv->async) {
+        dc1394error_t err = dc1394_capture_stop_async (camera);
+        DC1394_ERR_RTN (err, "Could not stop the capture thread");
+    }
     return d->capture_stop (cpriv->pcam);
 }
 
@@ -61,9 +156,13 @@ dc1394_capture_dequeue (dc1394camera_t * camera, dc1394capture_policy_t policy,
 {
     dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
     const platform_dispatch_t * d = cpriv->platform->dispatch;
+    dc1394error_t err;
     if (!d->capture_dequeue)
         return DC1394_FUNCTION_NOT_SUPPORTED;
-    return d->capture_dequeue (cpriv->pcam, policy, frame);
+    err = d->capture_dequeue (cpriv->pcam, policy, frame);
+    if (err == DC1394_SUCCESS && *frame)
+        capture_hold_begin (camera, *frame);
+    return err;
 }
 
 dc1394error_t
@@ -71,9 +170,56 @@ dc1394_capture_enqueue (dc1394camera_t * camera, dc1394video_frame_t * frame)
 {
     dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
     const platform_dispatch_t * d = cpriv->platform->dispatch;
+    dc1394error_t err;
     if (!d->capture_enqueue)
         return DC1394_FUNCTION_NOT_SUPPORTED;
-    return d->capture_enqueue (cpriv->pcam, frame);
+    capture_lock (cpriv);
+    err = capture_enqueue_frame (camera, frame);
+    capture_unlock (cpriv);
+    return err;
+}
+
+dc1394error_t
+dc1394_capture_set_reserve (dc1394camera_t * camera, uint32_t num_spare_buffers)
+{
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+    const platform_dispatch_t * d = cpriv->platform->dispatch;
+    if (!d->capture_retain)
+        return DC1394_FUNCTION_NOT_SUPPORTED;
+    cpriv->capture_reserve = num_spare_buffers;
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_capture_retain (dc1394camera_t * camera, dc1394video_frame_t * frame)
+{
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+    const platform_dispatch_t * d = cpriv->platform->dispatch;
+    dc1394error_t err;
+    if (!frame)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+    if (!d->capture_retain)
+        return DC1394_FUNCTION_NOT_SUPPORTED;
+    capture_lock (cpriv);
+    err = d->capture_retain (cpriv->pcam, frame);
+    capture_unlock (cpriv);
+    return err;
+}
+
+dc1394error_t
+dc1394_capture_release (dc1394camera_t * camera, dc1394video_frame_t * frame)
+{
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+    const platform_dispatch_t * d = cpriv->platform->dispatch;
+    dc1394error_t err;
+    if (!frame)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+    if (!d->capture_release)
+        return DC1394_FUNCTION_NOT_SUPPORTED;
+    capture_lock (cpriv);
+    err = d->capture_release (cpriv->pcam, frame);
+    capture_unlock (cpriv);
+    return err;
 }
 
 dc1394bool_t
@@ -88,3 +234,301 @@ dc1394_capture_is_frame_corrupt (dc1394camera_t * camera,
         return DC1394_FALSE;
     return d->capture_is_frame_corrupt (cpriv->pcam, frame);
 }
+
+dc1394error_t
+dc1394_capture_set_partial_delivery (dc1394camera_t * camera,
+        uint32_t packets_per_band)
+{
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+    const platform_dispatch_t * d = cpriv->platform->dispatch;
+    if (!d->capture_set_partial_delivery)
+        return DC1394_FUNCTION_NOT_SUPPORTED;
+    return d->capture_set_partial_delivery (cpriv->pcam, packets_per_band);
+}
+
+dc1394error_t
+dc1394_capture_wait_rows (dc1394camera_t * camera, dc1394video_frame_t * frame,
+        uint32_t rows, dc1394capture_policy_t policy)
+{
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+    const platform_dispatch_t * d = cpriv->platform->dispatch;
+    dc1394error_t err;
+    if (!frame)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+    // frames of other platforms are always complete when dequeued
+    if (!d->capture_wait_rows)
+        return DC1394_SUCCESS;
+    capture_lock (cpriv);
+    err = d->capture_wait_rows (cpriv->pcam, frame, rows, policy);
+    capture_unlock (cpriv);
+    return err;
+}
+
+dc1394error_t
+dc1394_capture_reconfigure (dc1394camera_t * camera)
+{
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+    const platform_dispatch_t * d = cpriv->platform->dispatch;
+    dc1394error_t err = DC1394_FUNCTION_NOT_SUPPORTED;
+
+    if (cpriv->async) {
+        dc1394_log_error ("Stop the capture thread before reconfiguring");
+        return DC1394_CAPTURE_IS_RUNNING;
+    }
+
+    if (d->capture_reconfigure) {
+        err = d->capture_reconfigure (cpriv->pcam);
+        if (err == DC1394_SUCCESS)
+            capture_reset_stats (camera);
+    }
+    if (err != DC1394_FUNCTION_NOT_SUPPORTED)
+        return err;
+
+    // fall back to a full restart
+    if (!cpriv->capture_restartable || !d->capture_setup || !d->capture_stop)
+        return DC1394_FUNCTION_NOT_SUPPORTED;
+    err = d->capture_stop (cpriv->pcam);
+    DC1394_ERR_RTN (err, "Could not stop the capture");
+    return dc1394_capture_setup (camera, cpriv->capture_buffers,
+            cpriv->capture_flags);
+}
+
+dc1394error_t
+dc1394_capture_get_recommended_buffers (dc1394camera_t * camera,
+        float overrun_probability, uint32_t * num_buffers)
+{
+    if (!num_buffers || overrun_probability <= 0 || overrun_probability >= 1)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+    *num_buffers = capture_recommend_buffers (camera, overrun_probability);
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_capture_set_auto_buffers (dc1394camera_t * camera,
+        float overrun_probability, uint32_t max_buffers)
+{
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+    const platform_dispatch_t * d = cpriv->platform->dispatch;
+    if (overrun_probability < 0 || overrun_probability >= 1)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+    if (!d->capture_grow && overrun_probability > 0)
+        return DC1394_FUNCTION_NOT_SUPPORTED;
+    capture_lock (cpriv);
+    cpriv->auto_buffers_target = overrun_probability;
+    cpriv->auto_buffers_max = max_buffers;
+    capture_unlock (cpriv);
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_capture_get_stats (dc1394camera_t * camera, dc1394capture_stats_t *stats)
+{
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+    if (!stats)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+    *stats = cpriv->capture_stats;
+    return DC1394_SUCCESS;
+}
+
+#ifdef CAPTURE_ASYNC
+static void
+capture_async_free (struct _capture_async_t * a)
+{
+    DC1394_CAMERA_PRIV (a->camera)->async = NULL;
+    close (a->wake_pipe[0]);
+    close (a->wake_pipe[1]);
+    pthread_mutex_destroy (&a->mutex);
+    free (a);
+}
+
+static void *
+capture_async_thread (void * arg)
+{
+    struct _capture_async_t * a = arg;
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (a->camera);
+    const platform_dispatch_t * d = cpriv->platform->dispatch;
+    dc1394video_frame_t * frame;
+    struct pollfd fds[2];
+    dc1394error_t err;
+    int give_back;
+
+    fds[0].fd = a->fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = a->wake_pipe[0];
+    fds[1].events = POLLIN;
+
+    while (1) {
+        if (poll (fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            dc1394_log_error ("Async capture: poll() failed: %s",
+                    strerror (errno));
+            break;
+        }
+        if (fds[1].revents)
+            break;
+        if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            dc1394_log_error ("Async capture: capture descriptor failed");
+            break;
+        }
+
+        // deliver all the frames that are ready
+        do {
+            pthread_mutex_lock (&a->mutex);
+            err = d->capture_dequeue (cpriv->pcam, DC1394_CAPTURE_POLICY_POLL,
+                    &frame);
+            if (frame)
+                capture_hold_begin (a->camera, frame);
+            pthread_mutex_unlock (&a->mutex);
+
+            if (err != DC1394_SUCCESS && frame == NULL) {
+                dc1394_log_error ("Async capture: dequeue failed: %s",
+                        dc1394_error_get_string (err));
+                return NULL;
+            }
+            if (frame == NULL)
+                break;
+
+            // frames that failed to be captured go straight back
+            give_back = err != DC1394_SUCCESS ||
+                a->callback (a->camera, frame, a->user) == DC1394_TRUE;
+
+            // the thread cannot join itself: it frees the camera for the
+            // callback once it has returned
+            if (a->free_camera) {
+                dc1394camera_t * camera = a->camera;
+                pthread_detach (a->thread);
+                capture_async_free (a);
+                dc1394_camera_free (camera);
+                return NULL;
+            }
+
+            if (give_back) {
+                pthread_mutex_lock (&a->mutex);
+                capture_enqueue_frame (a->camera, frame);
+                pthread_mutex_unlock (&a->mutex);
+            }
+        } while (1);
+    }
+
+    return NULL;
+}
+#endif
+
+dc1394error_t
+dc1394_capture_start_async (dc1394camera_t * camera,
+        dc1394capture_callback_t callback, void * user,
+        const dc1394capture_async_options_t * options)
+{
+#ifdef CAPTURE_ASYNC
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+    const platform_dispatch_t * d = cpriv->platform->dispatch;
+    struct _capture_async_t * a;
+    pthread_attr_t attr;
+    int ret;
+
+    if (!callback)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+    if (!d->capture_dequeue || !d->capture_enqueue || !d->capture_get_fileno)
+        return DC1394_FUNCTION_NOT_SUPPORTED;
+    if (cpriv->async)
+        return DC1394_CAPTURE_IS_RUNNING;
+
+    a = calloc (1, sizeof (struct _capture_async_t));
+    if (!a)
+        return DC1394_MEMORY_ALLOCATION_FAILURE;
+
+    a->camera = camera;
+    a->callback = callback;
+    a->user = user;
+    a->fd = d->capture_get_fileno (cpriv->pcam);
+    if (a->fd < 0) {
+        free (a);
+        return DC1394_CAPTURE_IS_NOT_SET;
+    }
+
+    if (pipe (a->wake_pipe) < 0) {
+        free (a);
+        return DC1394_FAILURE;
+    }
+    pthread_mutex_init (&a->mutex, NULL);
+
+    pthread_attr_init (&attr);
+    if (options && options->priority > 0) {
+        struct sched_param param;
+        param.sched_priority = options->priority;
+        pthread_attr_setinheritsched (&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy (&attr, SCHED_FIFO);
+        pthread_attr_setschedparam (&attr, &param);
+    }
+#ifdef HAVE_LINUX
+    if (options && options->cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO (&cpus);
+        CPU_SET (options->cpu, &cpus);
+        pthread_attr_setaffinity_np (&attr, sizeof (cpus), &cpus);
+    }
+#endif
+
+    // the thread may use the camera as soon as it starts
+    cpriv->async = a;
+    ret = pthread_create (&a->thread, &attr, capture_async_thread, a);
+    pthread_attr_destroy (&attr);
+    if (ret != 0) {
+        dc1394_log_error ("Async capture: could not start thread: %s",
+                strerror (ret));
+        cpriv->async = NULL;
+        close (a->wake_pipe[0]);
+        close (a->wake_pipe[1]);
+        pthread_mutex_destroy (&a->mutex);
+        free (a);
+        return DC1394_FAILURE;
+    }
+
+    return DC1394_SUCCESS;
+#else
+    return DC1394_FUNCTION_NOT_SUPPORTED;
+#endif
+}
+
+/* Called by dc1394_camera_free(): from the capture callback, the camera is
+ * only freed once the callback returns, and 1 is returned. */
+int
+capture_async_defer_free (dc1394camera_t * camera)
+{
+#ifdef CAPTURE_ASYNC
+    struct _capture_async_t * a = DC1394_CAMERA_PRIV (camera)->async;
+
+    if (a && pthread_equal (pthread_self (), a->thread)) {
+        a->free_camera = 1;
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+dc1394error_t
+dc1394_capture_stop_async (dc1394camera_t * camera)
+{
+#ifdef CAPTURE_ASYNC
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+    struct _capture_async_t * a = cpriv->async;
+    char ch = 0;
+
+    if (!a)
+        return DC1394_CAPTURE_IS_NOT_SET;
+    if (pthread_equal (pthread_self (), a->thread)) {
+        dc1394_log_error ("Async capture: cannot stop from the callback");
+        return DC1394_CAPTURE_IS_RUNNING;
+    }
+
+    if (write (a->wake_pipe[1], &ch, 1) != 1)
+        dc1394_log_warning ("Async capture: failed to wake up thread");
+    pthread_join (a->thread, NULL);
+    capture_async_free (a);
+
+    return DC1394_SUCCESS;
+#else
+    return DC1394_CAPTURE_IS_NOT_SET;
+#endif
+}
@@ -36,14 +36,17 @@
 /**
  * The capture policy.
  *
- * Can be blocking (wait for a frame forever) or polling (returns if no frames is in the ring buffer)
+ * Can be blocking (wait for a frame forever) or polling (returns if no frames is in the ring buffer). The latest policy
+ * returns the newest frame in the ring buffer and gives all older frames back to the ring, waiting for a frame if there is
+ * none. It is available on Juju, USB and video1394.
  */
 typedef enum {
     DC1394_CAPTURE_POLICY_WAIT=672,
-    DC1394_CAPTURE_POLICY_POLL
+    DC1394_CAPTURE_POLICY_POLL,
+    DC1394_CAPTURE_POLICY_LATEST
 } dc1394capture_policy_t;
 #define DC1394_CAPTURE_POLICY_MIN    DC1394_CAPTURE_POLICY_WAIT
-#define DC1394_CAPTURE_POLICY_MAX    DC1394_CAPTURE_POLICY_POLL
+#define DC1394_CAPTURE_POLICY_MAX    DC1394_CAPTURE_POLICY_LATEST
 #define DC1394_CAPTURE_POLICY_NUM   (DC1394_CAPTURE_POLICY_MAX - DC1394_CAPTURE_POLICY_MIN + 1)
 
 /**
@@ -54,6 +57,39 @@ typedef enum {
 #define DC1394_CAPTURE_FLAGS_BANDWIDTH_ALLOC 0x00000002U
 #define DC1394_CAPTURE_FLAGS_DEFAULT         0x00000004U /* a reasonable default value: do bandwidth and channel allocation */
 #define DC1394_CAPTURE_FLAGS_AUTO_ISO        0x00000008U /* automatically start iso before capture and stop it after */
+#define DC1394_CAPTURE_FLAGS_MULTICHANNEL    0x00000010U /* Juju: share one multichannel receive context with the other
+                                                            cameras of the card set up with this flag (Linux 2.6.36+) */
+
+/**
+ * Capture statistics
+ *
+ * Counters kept for each camera since the last call to dc1394_capture_setup(). Dropped frames are frames that the camera
+ * or the bus failed to deliver, overrun frames are frames that were lost because no buffer was available in the ring.
+ * Missing frames are detected from the frame timestamps and the expected frame period, so they are not counted when the
+ * camera is externally triggered.
+ */
+typedef struct {
+    uint64_t                 frames_received;
+    uint64_t                 frames_dropped;
+    uint64_t                 frames_overrun;
+    uint64_t                 frames_skipped;        /* frames given back to the ring unseen by the latest policy */
+} dc1394capture_stats_t;
+
+/**
+ * Frame callback of the asynchronous capture
+ *
+ * Called on the capture thread for each frame. Return DC1394_TRUE to give the frame back to the ring buffer when the callback
+ * returns, or DC1394_FALSE to keep it. Kept frames are given back later with dc1394_capture_enqueue(), from any thread.
+ */
+typedef dc1394bool_t (*dc1394capture_callback_t)(dc1394camera_t *camera, dc1394video_frame_t *frame, void *user);
+
+/**
+ * Options of the asynchronous capture thread
+ */
+typedef struct {
+    int32_t                  cpu;                   /* the CPU the thread is bound to, or -1 to let it run anywhere (Linux only) */
+    int32_t                  priority;              /* the SCHED_FIFO priority of the thread, or 0 for the default scheduling */
+} dc1394capture_async_options_t;
 
 #ifdef __cplusplus
 extern "C" {
@@ -74,7 +110,9 @@ dc1394error_t dc1394_capture_setup(dc1394camera_t *camera, uint32_t num_dma_buff
 dc1394error_t dc1394_capture_stop(dc1394camera_t *camera);
 
 /**
- * Gets a file descriptor to be used for select(). Must be called after dc1394_capture_setup().
+ * Gets a file descriptor to be used for select(). Must be called after dc1394_capture_setup(). Several frames may be
+ * signalled at once, so once the descriptor is readable frames should be dequeued with DC1394_CAPTURE_POLICY_POLL until
+ * none is returned.
  */
 int dc1394_capture_get_fileno (dc1394camera_t * camera);
 
@@ -100,6 +138,85 @@ dc1394error_t dc1394_capture_enqueue(dc1394camera_t * camera, dc1394video_frame_
 dc1394bool_t dc1394_capture_is_frame_corrupt (dc1394camera_t * camera,
         dc1394video_frame_t * frame);
 
+/**
+ * Sets the number of spare buffers allocated in addition to the ring buffer by the next dc1394_capture_setup(). Each
+ * retained frame is replaced in the ring by a spare buffer. Only available on Juju and USB.
+ */
+dc1394error_t dc1394_capture_set_reserve(dc1394camera_t *camera, uint32_t num_spare_buffers);
+
+/**
+ * Retains a dequeued frame: a spare buffer takes its place in the ring buffer and the frame stays valid until it is given
+ * back with dc1394_capture_release(). Calling dc1394_capture_enqueue() on a retained frame does nothing. Returns
+ * DC1394_CAPTURE_NO_SPARE_BUFFER when all the spare buffers are in use.
+ */
+dc1394error_t dc1394_capture_retain(dc1394camera_t *camera, dc1394video_frame_t *frame);
+
+/**
+ * Gives a retained frame back. Its buffer becomes a spare buffer again.
+ */
+dc1394error_t dc1394_capture_release(dc1394camera_t *camera, dc1394video_frame_t *frame);
+
+/**
+ * Enables partial frame delivery: the frames are returned by dc1394_capture_dequeue() as soon as their first band of
+ * packets_per_band packets has arrived, and the rows_available field of the frame grows as the following bands arrive.
+ * Use dc1394_capture_wait_rows() to wait for more lines. The band size is rounded up to a multiple of 8 packets when
+ * larger than 8, and 0 turns partial delivery off. Must be called before dc1394_capture_setup(). Only available on Juju.
+ */
+dc1394error_t dc1394_capture_set_partial_delivery(dc1394camera_t * camera, uint32_t packets_per_band);
+
+/**
+ * Waits until at least the given number of lines of a dequeued frame have been received. With the POLL policy the function
+ * returns immediately and rows_available tells how far the frame is. Frame corruption is only known once the whole frame
+ * has arrived, and a frame that is enqueued before it is complete blocks until it is.
+ */
+dc1394error_t dc1394_capture_wait_rows(dc1394camera_t * camera, dc1394video_frame_t * frame, uint32_t rows,
+                                       dc1394capture_policy_t policy);
+
+/**
+ * Starts delivering the captured frames to a callback on a thread owned by the library. Must be called after
+ * dc1394_capture_setup(). options can be NULL for an unbound thread with the default scheduling. While the thread runs,
+ * dc1394_capture_dequeue() must not be called by the user.
+ */
+dc1394error_t dc1394_capture_start_async(dc1394camera_t *camera, dc1394capture_callback_t callback, void *user,
+                                         const dc1394capture_async_options_t *options);
+
+/**
+ * Stops the capture thread. Returns once the callback has returned for the last time. Frames kept by the callback still
+ * have to be given back with dc1394_capture_enqueue(). Called by dc1394_capture_stop() if needed. Neither can be called
+ * from the callback, and DC1394_CAPTURE_IS_RUNNING is returned if they are; dc1394_camera_free() can, and then frees
+ * the camera once the callback returns.
+ */
+dc1394error_t dc1394_capture_stop_async(dc1394camera_t *camera);
+
+/**
+ * Adapts a running capture to the current video mode, Format_7 ROI or packet size of the camera. Change them with the
+ * transmission off, and enqueue every dequeued frame first: on Juju the call fails otherwise, and on the other
+ * platforms the frames would be freed. On Juju the iso context is opened again with a buffer for the new frames and the
+ * iso resources are kept when the new mode fits in them; otherwise, and on the other platforms, the capture is stopped
+ * and set up again with the same number of buffers and flags.
+ */
+dc1394error_t dc1394_capture_reconfigure(dc1394camera_t *camera);
+
+/**
+ * Gets the number of DMA buffers that would keep the probability of a ring buffer overrun under overrun_probability,
+ * judging from the frame period and from the time the application held the frames it dequeued so far. Until enough
+ * frames have been given back, the number of buffers requested at setup is returned.
+ */
+dc1394error_t dc1394_capture_get_recommended_buffers(dc1394camera_t *camera, float overrun_probability,
+                                                     uint32_t *num_buffers);
+
+/**
+ * Lets the ring buffer grow during the capture, up to max_buffers DMA buffers, whenever the recommended number of buffers
+ * for overrun_probability exceeds the current one. The capture is not interrupted. Use 0 to disable. Only available on
+ * USB with library-owned buffers; call it before dc1394_capture_setup() so that room for max_buffers is set aside.
+ */
+dc1394error_t dc1394_capture_set_auto_buffers(dc1394camera_t *camera, float overrun_probability, uint32_t max_buffers);
+
+/**
+ * Gets the capture statistics of the camera: the number of frames received, dropped and lost to ring overruns.
+ */
+dc1394error_t dc1394_capture_get_stats(dc1394camera_t * camera, dc1394capture_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -55,6 +55,7 @@ dc1394_reset_bus (dc1394camera_t * camera)
     const platform_dispatch_t * d = priv->platform->dispatch;
     if (!d->reset_bus)
         return DC1394_FUNCTION_NOT_SUPPORTED;
+    register_cache_invalidate (camera);
     return d->reset_bus (priv->pcam);
 }
 
@@ -80,6 +81,67 @@ dc1394_camera_get_node (dc1394camera_t *camera, uint32_t *node,
     return d->camera_get_node (priv->pcam, node, generation);
 }
 
+#ifdef HAVE_PTHREAD_H
+#define TRANSACTIONS_LOCK(t)   pthread_mutex_lock (&(t)->lock)
+#define TRANSACTIONS_UNLOCK(t) pthread_mutex_unlock (&(t)->lock)
+#else
+#define TRANSACTIONS_LOCK(t)
+#define TRANSACTIONS_UNLOCK(t)
+#endif
+
+dc1394error_t
+dc1394_camera_set_retry_policy (dc1394camera_t *camera,
+        const dc1394retry_policy_t *policy)
+{
+    transaction_stats_t * t = &DC1394_CAMERA_PRIV (camera)->transactions;
+
+    if (!policy || policy->initial_backoff > policy->max_backoff)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+    TRANSACTIONS_LOCK (t);
+    t->policy = *policy;
+    TRANSACTIONS_UNLOCK (t);
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_camera_get_retry_policy (dc1394camera_t *camera,
+        dc1394retry_policy_t *policy)
+{
+    transaction_stats_t * t = &DC1394_CAMERA_PRIV (camera)->transactions;
+
+    if (!policy)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+    TRANSACTIONS_LOCK (t);
+    *policy = t->policy;
+    TRANSACTIONS_UNLOCK (t);
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_camera_get_transaction_stats (dc1394camera_t *camera,
+        dc1394transaction_stats_t *stats)
+{
+    transaction_stats_t * t = &DC1394_CAMERA_PRIV (camera)->transactions;
+
+    if (!stats)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+    TRANSACTIONS_LOCK (t);
+    *stats = t->stats;
+    TRANSACTIONS_UNLOCK (t);
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_camera_reset_transaction_stats (dc1394camera_t *camera)
+{
+    transaction_stats_t * t = &DC1394_CAMERA_PRIV (camera)->transactions;
+
+    TRANSACTIONS_LOCK (t);
+    memset (&t->stats, 0, sizeof t->stats);
+    TRANSACTIONS_UNLOCK (t);
+    return DC1394_SUCCESS;
+}
+
 static dc1394error_t
 update_camera_info (dc1394camera_t *camera)
 {
@@ -191,102 +253,65 @@ dc1394_camera_print_info(dc1394camera_t *camera, FILE* fd)
     return DC1394_SUCCESS;
 }
 
-/*****************************************************
- dc1394_get_camera_feature_set
-
- Collects the available features for the camera
- described by node and stores them in features.
-*****************************************************/
-dc1394error_t
-dc1394_feature_get_all(dc1394camera_t *camera, dc1394featureset_t *features)
+/* Position of the inquiry and value registers of a feature in the blocks
+ * that start at REG_CAMERA_FEATURE_HI_BASE_INQ and REG_CAMERA_FEATURE_HI_BASE */
+int
+feature_register_index(dc1394feature_t feature)
 {
-    uint32_t i, j;
-    dc1394error_t err=DC1394_SUCCESS;
-
-    for (i= DC1394_FEATURE_MIN, j= 0; i <= DC1394_FEATURE_MAX; i++, j++)  {
-        features->feature[j].id= i;
-        err=dc1394_feature_get(camera, &features->feature[j]);
-        DC1394_ERR_RTN(err, "Could not get camera feature");
-    }
-
-    return err;
+    if (feature < DC1394_FEATURE_ZOOM)
+        return feature - DC1394_FEATURE_MIN;
+    else if (feature >= DC1394_FEATURE_CAPTURE_SIZE)
+        return 32 + feature + 12 - DC1394_FEATURE_ZOOM;
+    else
+        return 32 + feature - DC1394_FEATURE_ZOOM;
 }
 
-/*****************************************************
- dc1394_get_camera_feature
-
- Stores the bounds and options associated with the
- feature described by feature->id
-*****************************************************/
-dc1394error_t
-dc1394_feature_get(dc1394camera_t *camera, dc1394feature_info_t *feature)
+/* Fills a feature from its inquiry and value registers, all but the
+ * absolute values */
+void
+feature_decode_registers(dc1394feature_info_t *feature, uint32_t inquiry,
+                         uint32_t value)
 {
-    uint64_t offset;
-    uint32_t value;
-    dc1394error_t err;
+    int i, j;
 
-    if ( (feature->id < DC1394_FEATURE_MIN) || (feature->id > DC1394_FEATURE_MAX) ) {
-        return DC1394_INVALID_FEATURE;
+    feature->modes.num=0;
+    if (feature->id != DC1394_FEATURE_TRIGGER) {
+        if (inquiry & 0x01000000UL)
+            feature->modes.modes[feature->modes.num++]=DC1394_FEATURE_MODE_MANUAL;
+        if (inquiry & 0x02000000UL)
+            feature->modes.modes[feature->modes.num++]=DC1394_FEATURE_MODE_AUTO;
+        if (inquiry & 0x10000000UL)
+            feature->modes.modes[feature->modes.num++]=DC1394_FEATURE_MODE_ONE_PUSH_AUTO;
     }
 
-    // check presence
-    err=dc1394_feature_is_present(camera, feature->id, &(feature->available));
-    DC1394_ERR_RTN(err, "Could not check feature presence");
-
-    if (feature->available == DC1394_FALSE) {
-        return DC1394_SUCCESS;
-    }
-
-    // get capabilities
-    FEATURE_TO_INQUIRY_OFFSET(feature->id, offset);
-    err=dc1394_get_control_register(camera, offset, &value);
-    DC1394_ERR_RTN(err, "Could not check feature characteristics");
-
-    dc1394_feature_get_modes(camera, feature->id, &feature->modes);
-    dc1394_feature_get_mode(camera, feature->id, &feature->current_mode);
+    if (value & 0x04000000UL)
+        feature->current_mode= DC1394_FEATURE_MODE_ONE_PUSH_AUTO;
+    else if (value & 0x01000000UL)
+        feature->current_mode= DC1394_FEATURE_MODE_AUTO;
+    else
+        feature->current_mode= DC1394_FEATURE_MODE_MANUAL;
 
     switch (feature->id) {
     case DC1394_FEATURE_TRIGGER:
-        feature->polarity_capable= (value & 0x02000000UL) ? DC1394_TRUE : DC1394_FALSE;
-        int i, j;
-        uint32_t value_tmp;
+        feature->polarity_capable= (inquiry & 0x02000000UL) ? DC1394_TRUE : DC1394_FALSE;
 
         feature->trigger_modes.num=0;
-        value_tmp= (value & (0xFFFF));
-
         for (i=DC1394_TRIGGER_MODE_MIN;i<=DC1394_TRIGGER_MODE_MAX;i++) {
             j = i - DC1394_TRIGGER_MODE_MIN;
-            if (value_tmp & (0x1 << (15-j-(j>5)*8))) { // (i>5)*8 to take the mode gap into account
+            if ((inquiry & 0xFFFF) & (0x1 << (15-j-(j>5)*8))) { // (i>5)*8 to take the mode gap into account
                 feature->trigger_modes.modes[feature->trigger_modes.num]=i;
                 feature->trigger_modes.num++;
             }
         }
 
-        err=dc1394_external_trigger_get_supported_sources(camera,&feature->trigger_sources);
-        DC1394_ERR_RTN(err, "Could not get supported trigger sources");
-
-        break;
-    default:
-        feature->polarity_capable = 0;
-        feature->trigger_mode     = 0;
-
-        feature->min= (value & 0xFFF000UL) >> 12;
-        feature->max= (value & 0xFFFUL);
-        break;
-    }
-
-    feature->absolute_capable = (value & 0x40000000UL) ? DC1394_TRUE : DC1394_FALSE;
-    feature->readout_capable  = (value & 0x08000000UL) ? DC1394_TRUE : DC1394_FALSE;
-    feature->on_off_capable   = (value & 0x04000000UL) ? DC1394_TRUE : DC1394_FALSE;
-
-    // get current values
-    FEATURE_TO_VALUE_OFFSET(feature->id, offset);
-
-    err=dc1394_get_control_register(camera, offset, &value);
-    DC1394_ERR_RTN(err, "Could not get feature register");
+        feature->trigger_sources.num=0;
+        for (i = 0; i < DC1394_TRIGGER_SOURCE_NUM; i++) {
+            if (inquiry & (0x1 << (23-i-(i>3)*3))){
+                feature->trigger_sources.sources[feature->trigger_sources.num]=i+DC1394_TRIGGER_SOURCE_MIN;
+                feature->trigger_sources.num++;
+            }
+        }
 
-    switch (feature->id) {
-    case DC1394_FEATURE_TRIGGER:
         feature->trigger_polarity= (value & 0x01000000UL) ? DC1394_TRUE : DC1394_FALSE;
         feature->trigger_mode= (uint32_t)((value >> 16) & 0xF);
         if (feature->trigger_mode >= 14)
@@ -299,9 +324,18 @@ dc1394_feature_get(dc1394camera_t *camera, dc1394feature_info_t *feature)
         feature->trigger_source += DC1394_TRIGGER_SOURCE_MIN;
         break;
     default:
+        feature->polarity_capable = 0;
+        feature->trigger_mode     = 0;
+
+        feature->min= (inquiry & 0xFFF000UL) >> 12;
+        feature->max= (inquiry & 0xFFFUL);
         break;
     }
 
+    feature->absolute_capable = (inquiry & 0x40000000UL) ? DC1394_TRUE : DC1394_FALSE;
+    feature->readout_capable  = (inquiry & 0x08000000UL) ? DC1394_TRUE : DC1394_FALSE;
+    feature->on_off_capable   = (inquiry & 0x04000000UL) ? DC1394_TRUE : DC1394_FALSE;
+
     feature->is_on= (value & 0x02000000UL) ? DC1394_TRUE : DC1394_FALSE;
 
     switch (feature->id) {
@@ -323,18 +357,149 @@ dc1394_feature_get(dc1394camera_t *camera, dc1394feature_info_t *feature)
         break;
     }
 
+    if (feature->absolute_capable>0)
+        feature->abs_control = (value & 0x40000000UL) ? DC1394_ON: DC1394_OFF;
+}
+
+/* Fills a feature from its inquiry and value registers, then reads its
+ * absolute registers if it has them */
+static dc1394error_t
+feature_decode(dc1394camera_t *camera, dc1394feature_info_t *feature,
+               uint32_t inquiry, uint32_t value)
+{
+    dc1394error_t err=DC1394_SUCCESS;
+
+    feature_decode_registers(feature, inquiry, value);
+
     if (feature->absolute_capable>0) {
-        err=dc1394_feature_get_absolute_boundaries(camera, feature->id, &feature->abs_min, &feature->abs_max);
-        DC1394_ERR_RTN(err, "Could not get feature absolute min/max");
-        err=dc1394_feature_get_absolute_value(camera, feature->id, &feature->abs_value);
-        DC1394_ERR_RTN(err, "Could not get feature absolute value");
-        err=dc1394_feature_get_absolute_control(camera, feature->id, &feature->abs_control);
-        DC1394_ERR_RTN(err, "Could not get feature absolute control");
+        uint64_t absoffset;
+        uint32_t abs[3];
+
+        // min, max and value are contiguous in the absolute CSR; cameras
+        // that refuse block reads get them one quadlet at a time
+        err=QueryAbsoluteCSROffset(camera, feature->id, &absoffset);
+        DC1394_ERR_RTN(err, "Could not get feature absolute CSR offset");
+        if (dc1394_get_registers(camera, absoffset + REG_CAMERA_ABS_MIN, abs, 3) != DC1394_SUCCESS) {
+            err=dc1394_get_absolute_register(camera, feature->id, REG_CAMERA_ABS_MIN, &abs[0]);
+            DC1394_ERR_RTN(err, "Could not get feature absolute min");
+            err=dc1394_get_absolute_register(camera, feature->id, REG_CAMERA_ABS_MAX, &abs[1]);
+            DC1394_ERR_RTN(err, "Could not get feature absolute max");
+            err=dc1394_get_absolute_register(camera, feature->id, REG_CAMERA_ABS_VALUE, &abs[2]);
+            DC1394_ERR_RTN(err, "Could not get feature absolute value");
+        }
+        memcpy(&feature->abs_min, &abs[0], 4);
+        memcpy(&feature->abs_max, &abs[1], 4);
+        memcpy(&feature->abs_value, &abs[2], 4);
+    }
+
+    return err;
+}
+
+/*****************************************************
+ dc1394_get_camera_feature_set
+
+ Collects the available features for the camera
+ described by node and stores them in features.
+ They are read with a few block reads: the presence
+ bits, the inquiry block (which stays in the register
+ cache) and the span of the value block that covers
+ the features present.  Cameras that refuse block
+ reads are queried feature by feature.
+*****************************************************/
+dc1394error_t
+dc1394_feature_get_all(dc1394camera_t *camera, dc1394featureset_t *features)
+{
+    uint32_t presence[2], inquiry[FEATURE_BLOCK_QUADS], values[FEATURE_BLOCK_QUADS];
+    int first=FEATURE_BLOCK_QUADS, last=-1;
+    uint32_t i, j;
+    dc1394error_t err=DC1394_SUCCESS;
+
+    if (dc1394_get_control_registers(camera, REG_CAMERA_FEATURE_HI_INQ, presence, 2) != DC1394_SUCCESS ||
+        dc1394_get_control_registers(camera, REG_CAMERA_FEATURE_HI_BASE_INQ, inquiry,
+                                     FEATURE_BLOCK_QUADS) != DC1394_SUCCESS)
+        goto one_by_one;
+
+    for (i= DC1394_FEATURE_MIN; i <= DC1394_FEATURE_MAX; i++)  {
+        int index=feature_register_index(i);
+        if (is_feature_bit_set(presence[i >= DC1394_FEATURE_ZOOM], i) &&
+            (inquiry[index] & 0x80000000UL)) {
+            if (index < first)
+                first=index;
+            last=index;
+        }
+    }
+
+    if (last >= first &&
+        dc1394_get_control_registers(camera, REG_CAMERA_FEATURE_HI_BASE + first * 4U, values + first,
+                                     last - first + 1) != DC1394_SUCCESS)
+        goto one_by_one;
+
+    for (i= DC1394_FEATURE_MIN, j= 0; i <= DC1394_FEATURE_MAX; i++, j++)  {
+        dc1394feature_info_t *feature=&features->feature[j];
+        int index=feature_register_index(i);
+
+        feature->id= i;
+        feature->available= DC1394_FALSE;
+        if (index < first || index > last ||
+            !is_feature_bit_set(presence[i >= DC1394_FEATURE_ZOOM], i) ||
+            !(inquiry[index] & 0x80000000UL) || !(values[index] & 0x80000000UL))
+            continue;
+
+        feature->available= DC1394_TRUE;
+        err=feature_decode(camera, feature, inquiry[index], values[index]);
+        DC1394_ERR_RTN(err, "Could not get camera feature");
+    }
+    return err;
+
+ one_by_one:
+    dc1394_log_debug("Block reads of the feature registers failed, reading each feature");
+    for (i= DC1394_FEATURE_MIN, j= 0; i <= DC1394_FEATURE_MAX; i++, j++)  {
+        features->feature[j].id= i;
+        err=dc1394_feature_get(camera, &features->feature[j]);
+        DC1394_ERR_RTN(err, "Could not get camera feature");
     }
 
     return err;
 }
 
+/*****************************************************
+ dc1394_get_camera_feature
+
+ Stores the bounds and options associated with the
+ feature described by feature->id
+*****************************************************/
+dc1394error_t
+dc1394_feature_get(dc1394camera_t *camera, dc1394feature_info_t *feature)
+{
+    uint64_t offset;
+    uint32_t inquiry, value;
+    dc1394error_t err;
+
+    if ( (feature->id < DC1394_FEATURE_MIN) || (feature->id > DC1394_FEATURE_MAX) ) {
+        return DC1394_INVALID_FEATURE;
+    }
+
+    // check presence
+    err=dc1394_feature_is_present(camera, feature->id, &(feature->available));
+    DC1394_ERR_RTN(err, "Could not check feature presence");
+
+    if (feature->available == DC1394_FALSE) {
+        return DC1394_SUCCESS;
+    }
+
+    // get capabilities
+    FEATURE_TO_INQUIRY_OFFSET(feature->id, offset);
+    err=dc1394_get_control_register(camera, offset, &inquiry);
+    DC1394_ERR_RTN(err, "Could not check feature characteristics");
+
+    // get current values
+    FEATURE_TO_VALUE_OFFSET(feature->id, offset);
+    err=dc1394_get_control_register(camera, offset, &value);
+    DC1394_ERR_RTN(err, "Could not get feature register");
+
+    return feature_decode(camera, feature, inquiry, value);
+}
+
 /*****************************************************
  dc1394_print_feature
 
@@ -498,6 +663,7 @@ dc1394_camera_reset(dc1394camera_t *camera)
     dc1394error_t err;
     err=dc1394_set_control_register(camera, REG_CAMERA_INITIALIZE, DC1394_FEATURE_ON);
     DC1394_ERR_RTN(err, "Could not reset the camera");
+    register_cache_invalidate(camera);
     return err;
 }
 
@@ -968,6 +1134,124 @@ dc1394_video_get_transmission(dc1394camera_t *camera, dc1394switch_t *is_on)
     return err;
 }
 
+/* Whether a broadcast write reaches every camera of the group in one go:
+ * all on the same bus and identical, as broadcast commands require. */
+static int
+cameras_share_bus (dc1394camera_t ** cameras, uint32_t num_cameras)
+{
+    dc1394camera_priv_t * first = DC1394_CAMERA_PRIV (cameras[0]);
+    const platform_dispatch_t * d = first->platform->dispatch;
+    uint32_t bus0, bus;
+    uint32_t i;
+
+    if (num_cameras < 2 || !d->camera_get_bus || !d->set_broadcast)
+        return 0;
+    if (d->camera_get_bus (first->pcam, &bus0) != DC1394_SUCCESS)
+        return 0;
+
+    for (i = 1; i < num_cameras; i++) {
+        dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (cameras[i]);
+        if (cpriv->platform != first->platform ||
+                d->camera_get_bus (cpriv->pcam, &bus) != DC1394_SUCCESS ||
+                bus != bus0)
+            return 0;
+        if (cameras[i]->vendor_id != cameras[0]->vendor_id ||
+                cameras[i]->model_id != cameras[0]->model_id ||
+                cameras[i]->command_registers_base !=
+                cameras[0]->command_registers_base)
+            return 0;
+    }
+    return 1;
+}
+
+dc1394error_t
+dc1394_video_set_transmission_group(dc1394camera_t **cameras, uint32_t num_cameras,
+        dc1394switch_t pwr, uint32_t *skews)
+{
+    uint32_t value = (pwr == DC1394_ON) ? DC1394_FEATURE_ON : DC1394_FEATURE_OFF;
+    uint64_t * times, * done;
+    dc1394camera_t ** pending;
+    dc1394error_t * errs;
+    uint64_t first = UINT64_MAX;
+    dc1394error_t err = DC1394_SUCCESS;
+    uint32_t i, n;
+
+    if (!cameras || num_cameras == 0)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+    times = calloc (num_cameras, sizeof *times);
+    done = calloc (num_cameras, sizeof *done);
+    pending = calloc (num_cameras, sizeof *pending);
+    errs = calloc (num_cameras, sizeof *errs);
+    if (!times || !done || !pending || !errs) {
+        free (times);
+        free (done);
+        free (pending);
+        free (errs);
+        return DC1394_MEMORY_ALLOCATION_FAILURE;
+    }
+
+    if (cameras_share_bus (cameras, num_cameras)) {
+        dc1394bool_t was_broadcast = DC1394_FALSE;
+        dc1394error_t berr;
+        uint64_t t;
+
+        dc1394_camera_get_broadcast (cameras[0], &was_broadcast);
+        berr = dc1394_camera_set_broadcast (cameras[0], DC1394_TRUE);
+        if (berr == DC1394_SUCCESS) {
+            berr = dc1394_set_control_register (cameras[0], REG_CAMERA_ISO_EN,
+                    value);
+            t = capture_get_time_usec ();
+            if (!was_broadcast)
+                dc1394_camera_set_broadcast (cameras[0], DC1394_FALSE);
+
+            /* Some cameras ignore broadcast commands: check that each one
+             * followed, the others are written to below */
+            for (i = 0; berr == DC1394_SUCCESS && i < num_cameras; i++) {
+                uint32_t state;
+                if (dc1394_get_control_register (cameras[i], REG_CAMERA_ISO_EN,
+                            &state) == DC1394_SUCCESS &&
+                        (state & DC1394_FEATURE_ON) == value)
+                    times[i] = t;
+            }
+        }
+        if (berr != DC1394_SUCCESS)
+            dc1394_log_debug ("Broadcast of the transmission failed, writing "
+                    "to each camera");
+    }
+
+    /* Pipelined writes to the cameras the broadcast did not reach */
+    for (i = 0, n = 0; i < num_cameras; i++)
+        if (!times[i])
+            pending[n++] = cameras[i];
+    if (n > 0) {
+        control_register_write_group (pending, n, REG_CAMERA_ISO_EN, value,
+                errs, done);
+        for (i = 0, n = 0; i < num_cameras; i++) {
+            if (times[i])
+                continue;
+            if (errs[n] != DC1394_SUCCESS) {
+                dc1394_log_error ("Could not switch the transmission of "
+                        "camera %d", i);
+                err = errs[n];
+            }
+            times[i] = done[n++];
+        }
+    }
+
+    for (i = 0; i < num_cameras; i++)
+        if (times[i] < first)
+            first = times[i];
+    if (skews)
+        for (i = 0; i < num_cameras; i++)
+            skews[i] = times[i] - first;
+
+    free (times);
+    free (done);
+    free (pending);
+    free (errs);
+    return err;
+}
+
 dc1394error_t
 dc1394_video_set_one_shot(dc1394camera_t *camera, dc1394switch_t pwr)
 {
@@ -2128,6 +2412,8 @@ dc1394_camera_new_unit (dc1394_t * d, uint64_t guid, int unit)
 
     cpriv->pcam = pcam;
     cpriv->platform = info->platform;
+    register_cache_init (camera);
+    transaction_stats_init (camera);
     camera->guid = info->guid;
     camera->unit = info->unit;
     camera->unit_spec_ID = info->unit_spec_ID;
@@ -2183,10 +2469,20 @@ dc1394_camera_free(dc1394camera_t *camera)
 {
     dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
 
+    if (capture_async_defer_free (camera))
+        return;
+    if (cpriv->async)
+        dc1394_capture_stop_async(camera);
+    feature_monitor_free (camera);
+
     if (cpriv->iso_persist!=1)
         dc1394_iso_release_all(camera);
 
     cpriv->platform->dispatch->camera_free (cpriv->pcam);
+    free (cpriv->capture_hold.start);
+    register_cache_free (camera);
+    transaction_stats_free (camera);
+    profile_free (camera);
     free (camera->vendor);
     free (camera->model);
     free (camera);
@@ -46,6 +46,10 @@
 #include <dc1394/camera.h>
 #include <dc1394/control.h>
 #include <dc1394/capture.h>
+#include <dc1394/pipeline.h>
+#include <dc1394/syncgroup.h>
+#include <dc1394/profile.h>
+#include <dc1394/monitor.h>
 #include <dc1394/conversions.h>
 #include <dc1394/format7.h>
 #include <dc1394/iso.h>
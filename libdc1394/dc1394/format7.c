@@ -385,23 +385,24 @@ dc1394_format7_get_total_bytes(dc1394camera_t *camera,
                                uint64_t *total_bytes)
 {
     dc1394error_t err;
-    uint64_t value_hi, value_lo;
-    uint32_t value;
+    uint64_t base;
+    uint32_t value[2];
+    dc1394register_io_t io;
 
     if (!dc1394_is_video_mode_scalable(video_mode))
         return DC1394_INVALID_VIDEO_MODE;
 
-    err=dc1394_get_format7_register(camera, video_mode, REG_CAMERA_FORMAT7_TOTAL_BYTES_HI_INQ, &value);
-    DC1394_ERR_RTN(err, "Could not get total bytes - LSB");
-
-    value_hi=value;
-
-    err=dc1394_get_format7_register(camera, video_mode, REG_CAMERA_FORMAT7_TOTAL_BYTES_LO_INQ, &value);
-    DC1394_ERR_RTN(err, "Could not get total bytes - MSB");
+    err=get_format7_csr_base(camera, video_mode, &base);
+    DC1394_ERR_RTN(err, "Could not get the format7 CSR offset");
 
-    value_lo=value;
+    // the MSB and LSB registers are adjacent and read as one block
+    io.offset=base+REG_CAMERA_FORMAT7_TOTAL_BYTES_HI_INQ;
+    io.num_regs=2;
+    io.value=value;
+    err=dc1394_get_registers_vector(camera, &io, 1);
+    DC1394_ERR_RTN(err, "Could not get total bytes");
 
-    *total_bytes= (value_lo | ( value_hi << 32) );
+    *total_bytes= ((uint64_t)value[1] | ( (uint64_t)value[0] << 32) );
 
     return err;
 }
@@ -941,18 +942,39 @@ dc1394_format7_get_roi(dc1394camera_t *camera,
                        uint32_t *width, uint32_t *height)
 {
     dc1394error_t err;
+    uint64_t base;
+    uint32_t position, size, color_id, bpp;
+    dc1394register_io_t ios[4];
 
-    err=dc1394_format7_get_color_coding(camera, video_mode, color_coding);
-    DC1394_ERR_RTN(err, "Unable to get color_coding");
-
-    err=dc1394_format7_get_packet_size(camera, video_mode, packet_size);
-    DC1394_ERR_RTN(err, "Unable to get F7 bpp");
+    if (!dc1394_is_video_mode_scalable(video_mode))
+        return DC1394_INVALID_VIDEO_MODE;
 
-    err=dc1394_format7_get_image_position(camera, video_mode, left, top);
-    DC1394_ERR_RTN(err, "Unable to get image position");
+    err=get_format7_csr_base(camera, video_mode, &base);
+    DC1394_ERR_RTN(err, "Could not get the format7 CSR offset");
+
+    ios[0].offset=base+REG_CAMERA_FORMAT7_IMAGE_POSITION;
+    ios[0].value=&position;
+    ios[1].offset=base+REG_CAMERA_FORMAT7_IMAGE_SIZE;
+    ios[1].value=&size;
+    ios[2].offset=base+REG_CAMERA_FORMAT7_COLOR_CODING_ID;
+    ios[2].value=&color_id;
+    ios[3].offset=base+REG_CAMERA_FORMAT7_BYTE_PER_PACKET;
+    ios[3].value=&bpp;
+    ios[0].num_regs=ios[1].num_regs=ios[2].num_regs=ios[3].num_regs=1;
+    err=dc1394_get_registers_vector(camera, ios, 4);
+    DC1394_ERR_RTN(err, "Unable to get the ROI registers");
+
+    *color_coding= (uint32_t)(color_id>>24)+DC1394_COLOR_CODING_MIN;
+    *packet_size= (uint32_t) ( bpp & 0xFFFF0000UL ) >> 16;
+    *left= (uint32_t) ( position & 0xFFFF0000UL ) >> 16;
+    *top= (uint32_t) ( position & 0x0000FFFFUL );
+    *width= (uint32_t) ( size & 0xFFFF0000UL ) >> 16;
+    *height= (uint32_t) ( size & 0x0000FFFFUL );
 
-    err=dc1394_format7_get_image_size(camera, video_mode, width, height);
-    DC1394_ERR_RTN(err, "Unable to get image size");
+    if (*packet_size==0) {
+        dc1394_log_error("packet size is zero. This should not happen.");
+        return DC1394_FAILURE;
+    }
 
     return err;
 }
@@ -20,6 +20,11 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/time.h>
+
 #include "internal.h"
 #include "utils.h"
 #include "log.h"
@@ -285,6 +290,377 @@ capture_basic_setup (dc1394camera_t * camera, dc1394video_frame_t * frame)
     frame->little_endian=0;   // not used before 1.32 is out.
     frame->data_in_padding=0; // not used before 1.32 is out.
 
+    frame->packets_lost=0;
+    frame->frames_skipped=0;
+    frame->rows_available=frame->size[1];
+
     return DC1394_SUCCESS;
 }
 
+
+uint64_t
+capture_get_time_usec (void)
+{
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/**********************************************************
+ capture_reset_stats
+
+ Clears the capture counters and works out the frame period
+ used to detect missing frames. The period is only known in
+ advance for fixed video modes; in Format_7 it is learned from
+ the frame timestamps. Triggered cameras have no regular period.
+***********************************************************/
+void
+capture_reset_stats (dc1394camera_t * camera)
+{
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+    dc1394video_mode_t video_mode;
+    dc1394framerate_t framerate;
+    dc1394switch_t trigger;
+    float fps;
+
+    memset (&cpriv->capture_stats, 0, sizeof (dc1394capture_stats_t));
+    if (cpriv->capture_hold.start)
+        memset (cpriv->capture_hold.start, 0,
+                cpriv->capture_hold.num_slots * sizeof (uint64_t));
+    memset (cpriv->capture_hold.histogram, 0,
+            sizeof (cpriv->capture_hold.histogram));
+    cpriv->capture_hold.samples = 0;
+    cpriv->next_sequence = 0;
+    cpriv->last_frame_time = 0;
+    cpriv->frame_period = 0;
+    cpriv->frame_period_is_fixed = 0;
+
+    if (dc1394_external_trigger_get_power (camera, &trigger) == DC1394_SUCCESS
+            && trigger == DC1394_ON) {
+        cpriv->frame_period_is_fixed = 1;
+        return;
+    }
+
+    if (dc1394_video_get_mode (camera, &video_mode) != DC1394_SUCCESS)
+        return;
+    if (dc1394_is_video_mode_scalable (video_mode) == DC1394_TRUE)
+        return;
+
+    if (dc1394_video_get_framerate (camera, &framerate) == DC1394_SUCCESS &&
+            dc1394_framerate_as_float (framerate, &fps) == DC1394_SUCCESS) {
+        cpriv->frame_period = 1000000 / fps;
+        cpriv->frame_period_is_fixed = 1;
+    }
+}
+
+/**********************************************************
+ capture_account_frame
+
+ Called by the platforms for every frame they hand out.
+ frame_time is the time the frame was captured and buffer_time
+ the time its buffer was given to the driver, both in usec (0
+ if unknown). Frames missing between two timestamps are
+ counted as overruns if they arrived before the buffer was
+ available, as drops otherwise.
+***********************************************************/
+void
+capture_account_frame (dc1394camera_t * camera, dc1394video_frame_t * frame,
+        uint64_t frame_time, uint64_t buffer_time)
+{
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+    uint64_t last = cpriv->last_frame_time;
+    uint32_t period = cpriv->frame_period;
+    uint32_t missed = 0, overrun = 0;
+
+    if (frame_time && last && frame_time > last) {
+        uint64_t interval = frame_time - last;
+
+        if (period && interval > period * 3 / 2) {
+            missed = (interval + period / 2) / period - 1;
+            if (buffer_time > last) {
+                overrun = (buffer_time - last) / period;
+                if (overrun > missed)
+                    overrun = missed;
+            }
+        }
+
+        if (!cpriv->frame_period_is_fixed) {
+            if (!period || interval < period * 2 / 3)
+                cpriv->frame_period = interval;
+            else if (interval <= period * 3 / 2)
+                cpriv->frame_period = (7 * (uint64_t) period + interval) / 8;
+        }
+    }
+    if (frame_time)
+        cpriv->last_frame_time = frame_time;
+
+    if (missed)
+        dc1394_log_debug ("Missed %d frame(s) before frame %"PRIu64", "
+                "%d by overrun", missed, cpriv->next_sequence + missed,
+                overrun);
+
+    frame->frames_skipped = 0;
+    frame->sequence = cpriv->next_sequence + missed;
+    cpriv->next_sequence = frame->sequence + 1;
+
+    cpriv->capture_stats.frames_received++;
+    cpriv->capture_stats.frames_dropped += missed - overrun;
+    cpriv->capture_stats.frames_overrun += overrun;
+}
+
+/* Records the frames that were given back to the ring buffer before
+ * returning frame with the latest capture policy. */
+void
+capture_account_skipped (dc1394camera_t * camera, dc1394video_frame_t * frame,
+        uint32_t skipped)
+{
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+
+    frame->frames_skipped = skipped;
+    cpriv->capture_stats.frames_skipped += skipped;
+}
+
+/**********************************************************
+ capture_hold_begin, capture_hold_end
+
+ Measure the time the user holds each frame between its
+ dequeue and its enqueue. The times are kept in a histogram
+ of power-of-two bins that is halved now and then, so that
+ it follows changes of the consumer's load.
+***********************************************************/
+void
+capture_hold_begin (dc1394camera_t * camera, dc1394video_frame_t * frame)
+{
+    capture_hold_t * h = &DC1394_CAMERA_PRIV (camera)->capture_hold;
+
+    if (frame->id >= h->num_slots) {
+        uint32_t num = frame->id + 16;
+        uint64_t * start = realloc (h->start, num * sizeof (uint64_t));
+        if (!start)
+            return;
+        memset (start + h->num_slots, 0,
+                (num - h->num_slots) * sizeof (uint64_t));
+        h->start = start;
+        h->num_slots = num;
+    }
+    h->start[frame->id] = capture_get_time_usec ();
+}
+
+void
+capture_hold_end (dc1394camera_t * camera, dc1394video_frame_t * frame)
+{
+    capture_hold_t * h = &DC1394_CAMERA_PRIV (camera)->capture_hold;
+    uint64_t hold;
+    int bin = 0, i;
+
+    if (frame->id >= h->num_slots || !h->start[frame->id])
+        return;
+
+    hold = capture_get_time_usec () - h->start[frame->id];
+    h->start[frame->id] = 0;
+
+    while (bin < CAPTURE_HOLD_BINS - 1 && (hold >> (bin + 1)))
+        bin++;
+    h->histogram[bin]++;
+
+    if (++h->samples == 4096) {
+        h->samples = 0;
+        for (i = 0; i < CAPTURE_HOLD_BINS; i++) {
+            h->histogram[i] /= 2;
+            h->samples += h->histogram[i];
+        }
+    }
+}
+
+/**********************************************************
+ capture_recommend_buffers
+
+ Works out the number of DMA buffers that keeps the chance
+ of a ring overrun below overrun_probability: the frames
+ arriving while the user holds a frame for the matching
+ quantile of the hold times, one being filled by the driver
+ and one for the latency of the wake-up. Returns the depth
+ requested at setup while the hold times or the frame period
+ are not known yet.
+***********************************************************/
+uint32_t
+capture_recommend_buffers (dc1394camera_t * camera, float overrun_probability)
+{
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+    capture_hold_t * h = &cpriv->capture_hold;
+    uint32_t period = cpriv->frame_period;
+    uint32_t allowed, above = 0;
+    uint64_t hold;
+    int bin;
+
+    if (h->samples < 32 || !period)
+        return cpriv->capture_buffers;
+
+    allowed = overrun_probability * h->samples;
+    for (bin = CAPTURE_HOLD_BINS - 1; bin > 0; bin--) {
+        if (above + h->histogram[bin] > allowed)
+            break;
+        above += h->histogram[bin];
+    }
+
+    hold = (uint64_t) 1 << (bin + 1);
+    return (hold + period - 1) / period + 2;
+}
+
+/**********************************************************
+ transaction_stats_init
+
+ Sets the default retry policy of a camera and clears the
+ statistics of its register transactions.
+***********************************************************/
+#define TRANSACTION_INITIAL_BACKOFF 10
+#define TRANSACTION_MAX_BACKOFF     160
+
+void
+transaction_stats_init (dc1394camera_t * camera)
+{
+    transaction_stats_t * t = &DC1394_CAMERA_PRIV (camera)->transactions;
+
+    memset (&t->stats, 0, sizeof t->stats);
+    t->policy.max_attempts = 0;
+    t->policy.initial_backoff = TRANSACTION_INITIAL_BACKOFF;
+    t->policy.max_backoff = TRANSACTION_MAX_BACKOFF;
+    t->policy.deadline = 0;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_init (&t->lock, NULL);
+#endif
+}
+
+void
+transaction_stats_free (dc1394camera_t * camera)
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_destroy (&DC1394_CAMERA_PRIV (camera)->transactions.lock);
+#endif
+}
+
+/**********************************************************
+ transaction_retry_start
+
+ Called by the platforms before the first attempt of a
+ transaction. The camera may be NULL while it is being
+ opened, in which case the default policy is used.
+ default_attempts is the number of attempts of the platform,
+ used unless the policy sets one.
+***********************************************************/
+void
+transaction_retry_start (dc1394camera_t * camera, transaction_retry_t * r,
+        uint32_t default_attempts)
+{
+    memset (r, 0, sizeof *r);
+    r->start = capture_get_time_usec ();
+    r->seed = (uint32_t) r->start ^ (uint32_t) (uintptr_t) r;
+    if (!r->seed)
+        r->seed = 1;
+
+    if (camera) {
+        transaction_stats_t * t = &DC1394_CAMERA_PRIV (camera)->transactions;
+#ifdef HAVE_PTHREAD_H
+        pthread_mutex_lock (&t->lock);
+#endif
+        r->policy = t->policy;
+#ifdef HAVE_PTHREAD_H
+        pthread_mutex_unlock (&t->lock);
+#endif
+    }
+    else {
+        r->policy.initial_backoff = TRANSACTION_INITIAL_BACKOFF;
+        r->policy.max_backoff = TRANSACTION_MAX_BACKOFF;
+    }
+    if (!r->policy.max_attempts)
+        r->policy.max_attempts = default_attempts;
+}
+
+/**********************************************************
+ transaction_retry_next
+
+ Called by the platforms when an attempt failed with a code
+ worth retrying. Returns the time to wait before the next
+ attempt in usec, or -1 when the policy gives up, in which
+ case the response code is left to transaction_account().
+***********************************************************/
+int
+transaction_retry_next (transaction_retry_t * r, uint32_t rcode)
+{
+    uint32_t backoff, s;
+
+    if (r->attempts + 1 >= r->policy.max_attempts)
+        return -1;
+    if (r->policy.deadline &&
+            capture_get_time_usec () - r->start >= r->policy.deadline)
+        return -1;
+    if (rcode < 16)
+        r->rcodes[rcode]++;
+    r->attempts++;
+
+    backoff = r->policy.initial_backoff;
+    for (s = 1; s < r->attempts && backoff < r->policy.max_backoff; s++)
+        backoff *= 2;
+    if (backoff > r->policy.max_backoff)
+        backoff = r->policy.max_backoff;
+    if (!backoff)
+        return 0;
+
+    /* xorshift32 */
+    r->seed ^= r->seed << 13;
+    r->seed ^= r->seed >> 17;
+    r->seed ^= r->seed << 5;
+    return backoff + r->seed % backoff;
+}
+
+static int
+histogram_bin (uint64_t value)
+{
+    int bin = 0;
+
+    while (value >> bin && bin < DC1394_TRANSACTION_HISTOGRAM_BINS - 1)
+        bin++;
+    return bin;
+}
+
+/**********************************************************
+ transaction_account
+
+ Called by the platforms once a transaction is over, with
+ the response code of its last attempt.
+***********************************************************/
+void
+transaction_account (dc1394camera_t * camera, transaction_retry_t * r,
+        uint32_t rcode, dc1394error_t err)
+{
+    transaction_stats_t * t;
+    dc1394transaction_stats_t * s;
+    uint64_t latency;
+    int i;
+
+    if (!camera)
+        return;
+    t = &DC1394_CAMERA_PRIV (camera)->transactions;
+    s = &t->stats;
+    latency = capture_get_time_usec () - r->start;
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock (&t->lock);
+#endif
+    s->transactions++;
+    if (err != DC1394_SUCCESS)
+        s->failures++;
+    s->retries += r->attempts;
+    s->latency += latency;
+    if (latency > s->max_latency)
+        s->max_latency = latency;
+    s->latency_histogram[histogram_bin (latency)]++;
+    s->retry_histogram[histogram_bin (r->attempts)]++;
+    for (i = 0; i < 16; i++)
+        s->rcodes[i] += r->rcodes[i];
+    if (rcode < 16)
+        s->rcodes[rcode]++;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock (&t->lock);
+#endif
+}
@@ -26,6 +26,9 @@
 #include "config.h"
 #include "offsets.h"
 #include "platform.h"
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 typedef struct _platform_info_t {
     const platform_dispatch_t * dispatch;
@@ -34,6 +37,60 @@ typedef struct _platform_info_t {
     platform_t * p;
 } platform_info_t;
 
+struct _capture_async_t;
+struct _profile_snapshot_t;
+struct _feature_monitor_t;
+
+#define CAPTURE_HOLD_BINS 32
+
+/* Time for which the user keeps the dequeued frames, used to work out the
+ * depth of the ring buffer that keeps up with the consumer. */
+typedef struct _capture_hold_t {
+    uint64_t * start;           /* dequeue time of each frame id, 0 if not held */
+    uint32_t num_slots;
+    uint32_t histogram[CAPTURE_HOLD_BINS];  /* by log2 of the hold time [usec] */
+    uint32_t samples;
+} capture_hold_t;
+
+/* Values of the inquiry registers, which do not change while the camera
+ * is powered.  Open addressing on the register address; the cache is
+ * emptied when the bus generation changes or the camera is reset. */
+typedef struct _register_cache_t {
+    uint64_t * offsets;         /* 0 for an empty slot */
+    uint32_t * values;
+    uint32_t size;
+    uint32_t count;
+    uint32_t generation;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_t lock;       /* the cache is shared by the threads controlling the camera */
+#endif
+} register_cache_t;
+
+/* Statistics of the register transactions, kept up to date by the
+ * platforms, and the policy they retry transactions with. */
+typedef struct _transaction_stats_t {
+    dc1394transaction_stats_t stats;
+    dc1394retry_policy_t policy;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_t lock;       /* transactions may run in several threads */
+#endif
+} transaction_stats_t;
+
+/* Retries of one transaction.  The random state is kept here rather
+ * than in rand(), which is neither thread-safe nor different from one
+ * thread to the next. */
+typedef struct _transaction_retry_t {
+    dc1394retry_policy_t policy;
+    uint64_t start;
+    uint32_t attempts;
+    uint32_t seed;
+    uint32_t rcodes[16];
+} transaction_retry_t;
+
+/* Response codes for the platforms that only know about busy cameras */
+#define TRANSACTION_RCODE_BUSY      0x4
+#define TRANSACTION_RCODE_UNKNOWN   0xffffffff
+
 typedef struct _dc1394camera_priv_t {
     dc1394camera_t camera;
 
@@ -43,6 +100,29 @@ typedef struct _dc1394camera_priv_t {
     uint64_t allocated_channels;
     int allocated_bandwidth;
     int iso_persist;
+
+    dc1394capture_stats_t capture_stats;
+    uint64_t next_sequence;
+    uint64_t last_frame_time;
+    uint32_t frame_period;
+    int frame_period_is_fixed;
+    uint32_t capture_reserve;
+    uint32_t capture_buffers;
+    uint32_t capture_flags;
+    int capture_restartable;    /* set up with dc1394_capture_setup() */
+    capture_hold_t capture_hold;
+    float auto_buffers_target;
+    uint32_t auto_buffers_max;
+
+    struct _capture_async_t * async;
+
+    register_cache_t register_cache;
+    transaction_stats_t transactions;
+
+    struct _profile_snapshot_t * profile;
+    int profile_valid;          /* cleared by every register write */
+
+    struct _feature_monitor_t * monitor;
 } dc1394camera_priv_t;
 
 #define DC1394_CAMERA_PRIV(c) ((dc1394camera_priv_t *)c)
@@ -97,15 +177,6 @@ int refresh_enumeration (dc1394_t * d);
    However, 1394b allows for more channels, hence we use 64 as the limit */
 #define DC1394_NUM_ISO_CHANNELS     64
 
-/* A hard compiled factor that makes sure async read and writes don't happen
-   too fast */
-/* Toshiyuki Umeda: use randomize timings to avoid locking indefinitely.
-   If several thread are used the seed will be the same and the wait will therefor be
-   identical. A call to srand(getpid()) should be performed after calling the
-   raw1394_new_handle but I (Damien) not sure this would solve the problem as the handle
-   creation might have happened in the creating (as opposed to created) thread.*/
-#define DC1394_SLOW_DOWN            ((rand()%20)+10)
-
 /* Maximum number of characters in vendor and model strings */
 #define MAX_CHARS                      256
 
@@ -182,10 +253,65 @@ get_format_from_mode(uint32_t mode, uint32_t *format);
 dc1394bool_t
 is_feature_bit_set(uint32_t value, uint32_t feature);
 
+/* Number of registers from REG_CAMERA_FEATURE_HI_BASE to the end of the
+ * feature registers, and position of a feature in them */
+#define FEATURE_BLOCK_QUADS 64
+
+int
+feature_register_index(dc1394feature_t feature);
+
+void
+feature_decode_registers(dc1394feature_info_t *feature, uint32_t inquiry,
+                         uint32_t value);
+
+void
+feature_monitor_free(dc1394camera_t *camera);
+
+void
+profile_free(dc1394camera_t *camera);
+
 /*
 dc1394bool_t
 _dc1394_iidc_check_video_mode(dc1394camera_t *camera, dc1394video_mode_t *mode);
 */
 dc1394error_t capture_basic_setup (dc1394camera_t * camera, dc1394video_frame_t * frame);
 
+void capture_reset_stats (dc1394camera_t * camera);
+int capture_async_defer_free (dc1394camera_t * camera);
+void capture_account_frame (dc1394camera_t * camera, dc1394video_frame_t * frame,
+        uint64_t frame_time, uint64_t buffer_time);
+void capture_account_skipped (dc1394camera_t * camera,
+        dc1394video_frame_t * frame, uint32_t skipped);
+uint64_t capture_get_time_usec (void);
+void capture_hold_begin (dc1394camera_t * camera, dc1394video_frame_t * frame);
+void capture_hold_end (dc1394camera_t * camera, dc1394video_frame_t * frame);
+uint32_t capture_recommend_buffers (dc1394camera_t * camera,
+        float overrun_probability);
+
+dc1394error_t QueryFormat7CSROffset(dc1394camera_t *camera, dc1394video_mode_t mode,
+        uint64_t *offset);
+dc1394error_t QueryAbsoluteCSROffset(dc1394camera_t *camera, dc1394feature_t feature,
+        uint64_t *offset);
+
+dc1394error_t get_format7_csr_base (dc1394camera_t *camera, dc1394video_mode_t mode,
+        uint64_t *base);
+
+dc1394error_t register_cache_read (dc1394camera_t * camera, uint64_t offset,
+        uint32_t * value, uint32_t num_regs);
+void transaction_stats_init (dc1394camera_t * camera);
+void transaction_stats_free (dc1394camera_t * camera);
+void transaction_retry_start (dc1394camera_t * camera, transaction_retry_t * r,
+        uint32_t default_attempts);
+int transaction_retry_next (transaction_retry_t * r, uint32_t rcode);
+void transaction_account (dc1394camera_t * camera, transaction_retry_t * r,
+        uint32_t rcode, dc1394error_t err);
+
+void control_register_write_group (dc1394camera_t ** cameras, uint32_t num,
+        uint64_t offset, uint32_t value, dc1394error_t * errs,
+        uint64_t * times);
+
+void register_cache_init (dc1394camera_t * camera);
+void register_cache_invalidate (dc1394camera_t * camera);
+void register_cache_free (dc1394camera_t * camera);
+
 #endif /* _DC1394_INTERNAL_H */
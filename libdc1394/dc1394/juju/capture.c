@@ -43,13 +43,23 @@ static dc1394error_t
 init_frame(platform_camera_t *craw, int index, dc1394video_frame_t *proto)
 {
     int N = 8;        /* Number of iso packets per fw_cdev_iso_packet. */
+    int band = 0;     /* Number of fw_cdev_iso_packets per interrupt. */
     struct juju_frame *f = craw->frames + index;
     size_t total;
     int i, count;
 
+    if (craw->band_packets > 0) {
+        if (craw->band_packets < N)
+            N = craw->band_packets;
+        band = craw->band_packets / N;
+    }
+
     memcpy (&f->frame, proto, sizeof f->frame);
     f->frame.image = craw->buffer + index * proto->total_bytes;
     f->frame.id = index;
+    f->corrupt = 0;
+    f->packets_received = 0;
+    f->leased = 0;
     count = (proto->packets_per_frame + N - 1) / N;
     f->size = count * sizeof *f->packets;
     f->packets = malloc(f->size);
@@ -64,6 +74,8 @@ init_frame(platform_camera_t *craw, int index, dc1394video_frame_t *proto)
             N = total;
         f->packets[i].control = FW_CDEV_ISO_HEADER_LENGTH(craw->header_size * N)
             | FW_CDEV_ISO_PAYLOAD_LENGTH(proto->packet_size * N);
+        if (band > 0 && (i + 1) % band == 0)
+            f->packets[i].control |= FW_CDEV_ISO_INTERRUPT;
         total -= N;
     }
     f->packets[0].control |= FW_CDEV_ISO_SKIP;
@@ -92,12 +104,153 @@ queue_frame (platform_camera_t *craw, int index)
     queue.packets = ptr_to_u64(f->packets);
     queue.handle = craw->iso_handle;
 
+    f->corrupt = 0;
+    f->packets_received = 0;
+    f->frame.packets_lost = 0;
+    f->frame.rows_available = 0;
+    f->queued_time = capture_get_time_usec ();
     retval = ioctl(craw->iso_fd, FW_CDEV_IOC_QUEUE_ISO, &queue);
     if (retval < 0) {
         dc1394_log_error("queue_iso failed; %m");
         return DC1394_IOCTL_FAILURE;
     }
 
+    craw->queue[(craw->queue_head + craw->queue_count) % craw->num_frames] =
+        index;
+    craw->queue_count++;
+
+    return DC1394_SUCCESS;
+}
+
+/* Opens the iso context of the camera, maps a buffer for craw->num_frames
+ * frames laid out like proto, queues the first num_queued of them, keeps
+ * the others spare and starts the context. */
+static dc1394error_t
+start_iso_context (platform_camera_t * craw, dc1394video_frame_t * proto,
+        int num_queued)
+{
+    struct fw_cdev_create_iso_context create;
+    struct fw_cdev_start_iso start_iso;
+    dc1394error_t err;
+    int i, j;
+
+    // round the band size to whole fw_cdev_iso_packets
+    if (craw->band_packets > 8)
+        craw->band_packets = (craw->band_packets + 7) / 8 * 8;
+    if (craw->band_packets >= proto->packets_per_frame)
+        craw->band_packets = 0;
+
+    craw->iso_fd = open(craw->filename, O_RDWR);
+    if (craw->iso_fd < 0) {
+        dc1394_log_error("error opening file: %s", strerror (errno));
+        return DC1394_FAILURE;
+    }
+
+    create.type = FW_CDEV_ISO_CONTEXT_RECEIVE;
+    create.header_size = craw->header_size;
+    create.channel = craw->iso_channel;
+    create.speed = SCODE_400;
+    err = DC1394_IOCTL_FAILURE;
+    if (ioctl(craw->iso_fd, FW_CDEV_IOC_CREATE_ISO_CONTEXT, &create) < 0) {
+        dc1394_log_error("failed to create iso context");
+        goto error_fd;
+    }
+
+    craw->iso_handle = create.handle;
+
+    craw->queue_head = craw->queue_count = 0;
+    craw->ready_head = craw->ready_count = 0;
+    craw->spare_count = 0;
+    craw->buffer_size = proto->total_bytes * craw->num_frames;
+    craw->buffer =
+        mmap(NULL, craw->buffer_size, PROT_READ | PROT_WRITE , MAP_SHARED, craw->iso_fd, 0);
+    err = DC1394_IOCTL_FAILURE;
+    if (craw->buffer == MAP_FAILED)
+        goto error_fd;
+
+    err = DC1394_MEMORY_ALLOCATION_FAILURE;
+    craw->frames = malloc (craw->num_frames * sizeof *craw->frames);
+    craw->queue = malloc (craw->num_frames * sizeof *craw->queue);
+    craw->ready = malloc (craw->num_frames * sizeof *craw->ready);
+    craw->spare = malloc (craw->num_frames * sizeof *craw->spare);
+    if (craw->frames == NULL || craw->queue == NULL || craw->ready == NULL
+            || craw->spare == NULL)
+        goto error_mmap;
+
+    for (i = 0; i < craw->num_frames; i++) {
+        err = init_frame(craw, i, proto);
+        if (err != DC1394_SUCCESS) {
+            dc1394_log_error("error initing frames");
+            break;
+        }
+    }
+    if (err != DC1394_SUCCESS) {
+        for (j = 0; j < i; j++)
+            release_frame(craw, j);
+        goto error_mmap;
+    }
+
+    for (i = 0; i < num_queued; i++) {
+        err = queue_frame(craw, i);
+        if (err != DC1394_SUCCESS) {
+            dc1394_log_error("error queuing");
+            goto error_frames;
+        }
+    }
+    for (i = craw->num_frames - 1; i >= num_queued; i--)
+        craw->spare[craw->spare_count++] = i;
+
+    start_iso.cycle   = -1;
+    start_iso.tags = FW_CDEV_ISO_CONTEXT_MATCH_ALL_TAGS;
+    start_iso.sync = 1;
+    start_iso.handle = craw->iso_handle;
+    err = DC1394_IOCTL_FAILURE;
+    if (ioctl(craw->iso_fd, FW_CDEV_IOC_START_ISO, &start_iso) < 0) {
+        dc1394_log_error("error starting iso");
+        goto error_frames;
+    }
+
+    return DC1394_SUCCESS;
+
+error_frames:
+    for (i = 0; i < craw->num_frames; i++)
+        release_frame(craw, i);
+error_mmap:
+    free (craw->frames);
+    free (craw->queue);
+    free (craw->ready);
+    free (craw->spare);
+    craw->frames = NULL;
+    craw->queue = craw->ready = craw->spare = NULL;
+    munmap(craw->buffer, craw->buffer_size);
+error_fd:
+    close(craw->iso_fd);
+
+    return err;
+}
+
+/* Stops and closes the iso context of the camera, which drops the
+ * descriptors still queued in it, and frees its frames. */
+static dc1394error_t
+stop_iso_context (platform_camera_t * craw)
+{
+    struct fw_cdev_stop_iso stop;
+    int i;
+
+    stop.handle = craw->iso_handle;
+    if (ioctl(craw->iso_fd, FW_CDEV_IOC_STOP_ISO, &stop) < 0)
+        return DC1394_IOCTL_FAILURE;
+
+    munmap(craw->buffer, craw->buffer_size);
+    close(craw->iso_fd);
+    for (i = 0; i<craw->num_frames; i++)
+        release_frame(craw, i);
+    free (craw->frames);
+    free (craw->queue);
+    free (craw->ready);
+    free (craw->spare);
+    craw->frames = NULL;
+    craw->queue = craw->ready = craw->spare = NULL;
     return DC1394_SUCCESS;
 }
 
@@ -105,16 +258,15 @@ dc1394error_t
 dc1394_juju_capture_setup(platform_camera_t *craw, uint32_t num_dma_buffers,
         uint32_t flags)
 {
-    struct fw_cdev_create_iso_context create;
-    struct fw_cdev_start_iso start_iso;
     dc1394error_t err;
     dc1394video_frame_t proto;
-    int i, j, retval;
     dc1394camera_t * camera = craw->camera;
+    uint32_t reserve = DC1394_CAMERA_PRIV (camera)->capture_reserve;
 
     if (flags & DC1394_CAPTURE_FLAGS_DEFAULT)
         flags = DC1394_CAPTURE_FLAGS_CHANNEL_ALLOC |
-            DC1394_CAPTURE_FLAGS_BANDWIDTH_ALLOC;
+            DC1394_CAPTURE_FLAGS_BANDWIDTH_ALLOC |
+            (flags & DC1394_CAPTURE_FLAGS_MULTICHANNEL);
 
     craw->flags = flags;
 
@@ -168,74 +320,28 @@ dc1394_juju_capture_setup(platform_camera_t *craw, uint32_t num_dma_buffers,
         return DC1394_FAILURE;
     dc1394_log_debug ("juju: Receiving from iso channel %d", craw->iso_channel);
 
-    craw->iso_fd = open(craw->filename, O_RDWR);
-    if (craw->iso_fd < 0) {
-        dc1394_log_error("error opening file: %s", strerror (errno));
-        return DC1394_FAILURE;
-    }
-
-    create.type = FW_CDEV_ISO_CONTEXT_RECEIVE;
-    create.header_size = craw->header_size;
-    create.channel = craw->iso_channel;
-    create.speed = SCODE_400;
-    err = DC1394_IOCTL_FAILURE;
-    if (ioctl(craw->iso_fd, FW_CDEV_IOC_CREATE_ISO_CONTEXT, &create) < 0) {
-        dc1394_log_error("failed to create iso context");
-        goto error_fd;
-    }
-
-    craw->iso_handle = create.handle;
-
-    craw->num_frames = num_dma_buffers;
-    craw->current = -1;
-    craw->buffer_size = proto.total_bytes * num_dma_buffers;
-    craw->buffer =
-        mmap(NULL, craw->buffer_size, PROT_READ | PROT_WRITE , MAP_SHARED, craw->iso_fd, 0);
-    err = DC1394_IOCTL_FAILURE;
-    if (craw->buffer == MAP_FAILED)
-        goto error_fd;
-
-    err = DC1394_MEMORY_ALLOCATION_FAILURE;
-    craw->frames = malloc (num_dma_buffers * sizeof *craw->frames);
-    if (craw->frames == NULL)
-        goto error_mmap;
-
-    for (i = 0; i < num_dma_buffers; i++) {
-        err = init_frame(craw, i, &proto);
-        if (err != DC1394_SUCCESS) {
-            dc1394_log_error("error initing frames");
-            break;
+    if (flags & DC1394_CAPTURE_FLAGS_MULTICHANNEL) {
+        if (craw->kernel_version >= 4) {
+            err = juju_mc_capture_setup (craw, num_dma_buffers, &proto);
+            if (err != DC1394_SUCCESS)
+                return err;
+            craw->capture_is_set = 1;
+            goto start_transmission;
         }
-    }
-    if (err != DC1394_SUCCESS) {
-        for (j = 0; j < i; j++)
-            release_frame(craw, j);
-        goto error_mmap;
+        dc1394_log_warning ("juju: Multichannel reception needs kernel "
+                "2.6.36, using a context of its own");
     }
 
-    for (i = 0; i < num_dma_buffers; i++) {
-        err = queue_frame(craw, i);
-        if (err != DC1394_SUCCESS) {
-            dc1394_log_error("error queuing");
-            goto error_frames;
-        }
-    }
+    craw->num_frames = num_dma_buffers + reserve;
+    err = start_iso_context (craw, &proto, num_dma_buffers);
+    if (err != DC1394_SUCCESS)
+        return err;
 
     // starting from here we use the ISO channel so we set the flag in
     // the camera struct:
     craw->capture_is_set = 1;
 
-    start_iso.cycle   = -1;
-    start_iso.tags = FW_CDEV_ISO_CONTEXT_MATCH_ALL_TAGS;
-    start_iso.sync = 1;
-    start_iso.handle = craw->iso_handle;
-    retval = ioctl(craw->iso_fd, FW_CDEV_IOC_START_ISO, &start_iso);
-    err = DC1394_IOCTL_FAILURE;
-    if (retval < 0) {
-        dc1394_log_error("error starting iso");
-        goto error_frames;
-    }
-
+start_transmission:
     // if auto iso is requested, start ISO
     if (flags & DC1394_CAPTURE_FLAGS_AUTO_ISO) {
         err=dc1394_video_set_transmission(camera, DC1394_ON);
@@ -244,38 +350,23 @@ dc1394_juju_capture_setup(platform_camera_t *craw, uint32_t num_dma_buffers,
     }
 
     return DC1394_SUCCESS;
-
-error_frames:
-    for (i = 0; i < num_dma_buffers; i++)
-        release_frame(craw, i);
-error_mmap:
-    munmap(craw->buffer, craw->buffer_size);
-error_fd:
-    close(craw->iso_fd);
-
-    return err;
 }
 
 dc1394error_t
 dc1394_juju_capture_stop(platform_camera_t *craw)
 {
     dc1394camera_t * camera = craw->camera;
-    struct fw_cdev_stop_iso stop;
-    int i;
 
     if (craw->capture_is_set == 0)
         return DC1394_CAPTURE_IS_NOT_SET;
 
-    stop.handle = craw->iso_handle;
-    if (ioctl(craw->iso_fd, FW_CDEV_IOC_STOP_ISO, &stop) < 0)
-        return DC1394_IOCTL_FAILURE;
-
-    munmap(craw->buffer, craw->buffer_size);
-    close(craw->iso_fd);
-    for (i = 0; i<craw->num_frames; i++)
-        release_frame(craw, i);
-    free (craw->frames);
-    craw->frames = NULL;
+    if (craw->mc) {
+        juju_mc_capture_stop (craw);
+    } else {
+        dc1394error_t err = stop_iso_context (craw);
+        if (err != DC1394_SUCCESS)
+            return err;
+    }
     craw->capture_is_set = 0;
 
     if (craw->capture_iso_resource) {
@@ -294,6 +385,139 @@ dc1394_juju_capture_stop(platform_camera_t *craw)
     return DC1394_SUCCESS;
 }
 
+/* Adapts the capture to a new video mode or Format_7 ROI without giving
+ * back the iso resources: the iso context is closed and opened again with a
+ * buffer for the new frames, since a stopped context keeps the descriptors
+ * that were queued in it.  That requires the mode to fit in the bandwidth
+ * allocated at setup and all the frames to be back in the ring.
+ * DC1394_FUNCTION_NOT_SUPPORTED tells the caller to fall back to a full
+ * restart. */
+dc1394error_t
+dc1394_juju_capture_reconfigure (platform_camera_t * craw)
+{
+    dc1394camera_t * camera = craw->camera;
+    dc1394video_frame_t proto;
+    uint32_t bandwidth_units = 0;
+    int num_queued;
+    dc1394error_t err;
+
+    if (craw->capture_is_set == 0)
+        return DC1394_CAPTURE_IS_NOT_SET;
+    if (craw->mc)
+        return DC1394_FUNCTION_NOT_SUPPORTED;
+
+    if (craw->queue_count + craw->ready_count + craw->spare_count
+            < craw->num_frames) {
+        dc1394_log_error ("juju: All frames must be enqueued before "
+                "reconfiguring the capture");
+        return DC1394_FAILURE;
+    }
+
+    if (capture_basic_setup (camera, &proto) != DC1394_SUCCESS) {
+        dc1394_log_error ("juju: Basic capture setup failed");
+        return DC1394_FAILURE;
+    }
+
+    if (craw->capture_iso_resource &&
+            (craw->flags & DC1394_CAPTURE_FLAGS_BANDWIDTH_ALLOC)) {
+        dc1394_video_get_bandwidth_usage (camera, &bandwidth_units);
+        if (bandwidth_units > craw->capture_iso_resource->bandwidth) {
+            dc1394_log_debug ("juju: New mode needs more bandwidth");
+            return DC1394_FUNCTION_NOT_SUPPORTED;
+        }
+    }
+
+    num_queued = craw->num_frames - craw->spare_count;
+    err = stop_iso_context (craw);
+    if (err != DC1394_SUCCESS)
+        return err;
+
+    err = start_iso_context (craw, &proto, num_queued);
+    if (err != DC1394_SUCCESS) {
+        // the capture is gone, give back its iso resources
+        craw->capture_is_set = 0;
+        if (craw->capture_iso_resource) {
+            if (juju_iso_deallocate (craw, craw->capture_iso_resource) < 0)
+                dc1394_log_warning ("juju: Failed to deallocate iso resources");
+            craw->capture_iso_resource = NULL;
+        }
+        return err;
+    }
+
+    dc1394_log_debug ("juju: Capture reconfigured to %dx%d",
+            proto.size[0], proto.size[1]);
+    return DC1394_SUCCESS;
+}
+
+/* Number of bus cycles after which the 3 bits cycleSeconds and 13 bits
+ * cycleCount of an iso timestamp wrap around */
+#define CYCLES_PER_WRAP (8 * 8000)
+
+static uint32_t
+timestamp_to_cycles (uint32_t timestamp)
+{
+    return ((timestamp >> 13) & 0x7) * 8000 + (timestamp & 0x1fff);
+}
+
+#define NO_CYCLE 0xffffffff
+
+/* Walks the stripped headers of the packets delivered with one interrupt,
+ * which cover the next span packets of the frame.  Each packet must carry
+ * the expected payload length, only the first packet of the frame may carry
+ * the sync bit, and (if timestamps are available) no cycle may have been
+ * skipped between two packets.  Headers that did not fit in the header
+ * buffer of the kernel are dropped by it and are not counted as lost. */
+static void
+check_packet_headers (platform_camera_t * craw, struct juju_frame * f,
+        struct fw_cdev_event_iso_interrupt * iso, uint32_t span)
+{
+    int quads = craw->header_size / 4;
+    uint32_t num = iso->header_length / craw->header_size;
+    uint32_t lost = 0;
+    uint32_t cycle, packet;
+    int i;
+
+    if (num > span)
+        num = span;
+    if (num < span &&
+            iso->header_length + craw->header_size <= getpagesize ())
+        lost += span - num;
+
+    for (i = 0; i < num; i++) {
+        uint32_t header = ntohl (iso->header[i * quads]);
+        uint32_t data_length = header >> 16;
+        uint32_t sy = header & 0xf;
+
+        packet = f->packets_received + i;
+
+        if (data_length != f->frame.packet_size) {
+            dc1394_log_debug ("Juju: packet %d has %d bytes, expected %d",
+                    packet, data_length, f->frame.packet_size);
+            lost++;
+        }
+
+        if ((packet == 0 && sy != 1) || (packet > 0 && sy == 1)) {
+            dc1394_log_debug ("Juju: unexpected sy %d on packet %d",
+                    sy, packet);
+            f->corrupt = 1;
+        }
+
+        if (quads < 2)
+            continue;
+
+        cycle = timestamp_to_cycles (ntohl (iso->header[i * quads + 1]));
+        if (packet > 0 && f->last_cycle != NO_CYCLE)
+            lost += (cycle + CYCLES_PER_WRAP - f->last_cycle - 1)
+                % CYCLES_PER_WRAP;
+        f->last_cycle = cycle;
+    }
+
+    if (num < span)
+        f->last_cycle = NO_CYCLE;
+
+    f->frame.packets_lost += lost;
+}
+
 static uint32_t
 bus_time_to_usec (uint32_t bus)
 {
@@ -303,103 +527,242 @@ bus_time_to_usec (uint32_t bus)
     return sec * 1000000 + cycles * 125 + subcycle * 125 / 3072;
 }
 
-dc1394error_t
-dc1394_juju_capture_dequeue (platform_camera_t * craw,
-        dc1394capture_policy_t policy, dc1394video_frame_t **frame_return)
+static void
+compute_timestamp (platform_camera_t * craw, struct juju_frame * f,
+        struct fw_cdev_event_iso_interrupt * iso, uint32_t span)
+{
+    struct fw_cdev_get_cycle_timer tm;
+
+    f->frame.timestamp = 0;
+    if (ioctl(craw->iso_fd, FW_CDEV_IOC_GET_CYCLE_TIMER, &tm) < 0)
+        return;
+
+    /* Current bus time in usec as retrieved by the ioctl */
+    uint32_t bus_time = bus_time_to_usec(tm.cycle_timer);
+    /* Bus time of the interrupt packet (end of frame or band) */
+    uint32_t dma_time = iso->cycle;
+    /* Estimated usec between start of frame and the interrupt packet */
+    uint32_t diff = (span - 1) * 125;
+
+    /* If per-packet timestamps are available in the headers use them */
+    if (craw->header_size >= 8) {
+        uint8_t * b = (uint8_t *)(iso->header + 1);
+        /* Bus time of the first frame in the packet */
+        dma_time = (b[2] << 8) | b[3];
+        dc1394_log_debug("Juju: using cycle 0x%04x (diff was %d)",
+                dma_time, diff);
+        diff = 0;
+    }
+    /* Convert to usec */
+    dma_time = bus_time_to_usec(dma_time << 12);
+
+    /* Amount to subtract from local_time to get frame start time */
+    diff += (bus_time + 8000000 - dma_time) % 8000000;
+    dc1394_log_debug("Juju: frame latency %d us", diff);
+
+    f->frame.timestamp = tm.local_time - diff;
+}
+
+static void
+push_ready (platform_camera_t * craw, int index)
+{
+    craw->ready[(craw->ready_head + craw->ready_count) % craw->num_frames] =
+        index;
+    craw->ready_count++;
+}
+
+static struct juju_frame *
+pop_ready (platform_camera_t * craw)
+{
+    struct juju_frame *f = craw->frames + craw->ready[craw->ready_head];
+
+    craw->ready_head = (craw->ready_head + 1) % craw->num_frames;
+    craw->ready_count--;
+    return f;
+}
+
+/* Reads one event from the iso context.  Iso interrupts are credited to the
+ * frame at the head of the kernel queue: with partial delivery each of them
+ * carries one band of the frame, otherwise the whole frame.  A frame is
+ * made available to dequeue once its first band (or the whole frame) has
+ * arrived.  Returns 1 if an event was read, 0 if none was pending before
+ * the timeout and -1 on errors. */
+static int
+read_iso_event (platform_camera_t * craw, int timeout)
 {
     struct pollfd fds[1];
     struct juju_frame *f;
-    int err, len;
-    struct fw_cdev_get_cycle_timer tm;
+    uint32_t ppf = craw->frames[0].frame.packets_per_frame;
+    uint32_t span;
+    int err, len, first;
     struct {
         struct fw_cdev_event_iso_interrupt i;
-        __u32 headers[craw->frames[0].frame.packets_per_frame*2 + 16];
+        __u32 headers[ppf*2 + 16];
     } iso;
 
-    if ( (policy<DC1394_CAPTURE_POLICY_MIN) || (policy>DC1394_CAPTURE_POLICY_MAX) )
-        return DC1394_INVALID_CAPTURE_POLICY;
-
-    // default: return NULL in case of failures or lack of frames
-    *frame_return=NULL;
-
     fds[0].fd = craw->iso_fd;
     fds[0].events = POLLIN;
 
     while (1) {
-        err = poll(fds, 1, (policy == DC1394_CAPTURE_POLICY_POLL) ? 0 : -1);
+        err = poll(fds, 1, timeout);
         if (err < 0) {
             if (errno == EINTR)
                 continue;
             dc1394_log_error("poll() failed for device %s.", craw->filename);
-            return DC1394_FAILURE;
+            return -1;
         } else if (err == 0) {
-            return DC1394_SUCCESS;
+            return 0;
         }
 
         len = read (craw->iso_fd, &iso, sizeof iso);
         if (len < 0) {
             dc1394_log_error("Juju: dequeue failed to read a response: %m");
-            return DC1394_FAILURE;
+            return -1;
         }
 
         if (iso.i.type == FW_CDEV_EVENT_ISO_INTERRUPT)
             break;
     }
 
-    craw->current = (craw->current + 1) % craw->num_frames;
-    f = craw->frames + craw->current;
+    if (craw->queue_count == 0) {
+        dc1394_log_warning("Juju: iso event while no frame is queued");
+        return 1;
+    }
+    f = craw->frames + craw->queue[craw->queue_head];
 
     dc1394_log_debug("Juju: got iso event, cycle 0x%04x, header_len %d",
             iso.i.cycle, iso.i.header_length);
 
-    f->frame.frames_behind = 0;
-    f->frame.timestamp = 0;
+    span = ppf - f->packets_received;
+    if (craw->band_packets > 0 && craw->band_packets < span)
+        span = craw->band_packets;
 
-    /* Compute timestamp */
-    if (ioctl(craw->iso_fd, FW_CDEV_IOC_GET_CYCLE_TIMER, &tm) == 0) {
-        /* Current bus time in usec as retrieved by the ioctl */
-        uint32_t bus_time = bus_time_to_usec(tm.cycle_timer);
-        /* Bus time of the interrupt packet (end of frame) */
-        uint32_t dma_time = iso.i.cycle;
-        /* Estimated usec between start of frame and end of frame */
-        uint32_t diff =
-            (craw->frames[0].frame.packets_per_frame - 1) * 125;
-
-        /* If per-packet timestamps are available in the headers use them */
-        if (craw->header_size >= 8) {
-            uint8_t * b = (uint8_t *)(iso.i.header + 1);
-            /* Bus time of the first frame in the packet */
-            dma_time = (b[2] << 8) | b[3];
-            dc1394_log_debug("Juju: using cycle 0x%04x (diff was %d)",
-                    dma_time, diff);
-            diff = 0;
-        }
-        /* Convert to usec */
-        dma_time = bus_time_to_usec(dma_time << 12);
+    first = (f->packets_received == 0);
+    if (first)
+        f->last_cycle = NO_CYCLE;
+
+    check_packet_headers (craw, f, &iso.i, span);
+    f->packets_received += span;
+
+    if (first) {
+        compute_timestamp (craw, f, &iso.i, span);
+        capture_account_frame (craw->camera, &f->frame, f->frame.timestamp,
+                f->queued_time);
+        if (craw->band_packets > 0)
+            push_ready (craw, f->frame.id);
+    }
+
+    if (f->packets_received < ppf) {
+        uint64_t rows = (uint64_t) f->packets_received * f->frame.packet_size
+            / f->frame.stride;
+        f->frame.rows_available = rows < f->frame.size[1] ? rows :
+            f->frame.size[1];
+        return 1;
+    }
+
+    f->frame.rows_available = f->frame.size[1];
+    if (f->frame.packets_lost > 0)
+        f->corrupt = 1;
+    if (f->corrupt)
+        dc1394_log_warning ("Juju: frame %d is corrupt, %d packets lost",
+                f->frame.id, f->frame.packets_lost);
 
-        /* Amount to subtract from local_time to get frame start time */
-        diff += (bus_time + 8000000 - dma_time) % 8000000;
-        dc1394_log_debug("Juju: frame latency %d us", diff);
+    craw->queue_head = (craw->queue_head + 1) % craw->num_frames;
+    craw->queue_count--;
+    if (craw->band_packets == 0)
+        push_ready (craw, f->frame.id);
 
-        f->frame.timestamp = tm.local_time - diff;
+    return 1;
+}
+
+dc1394error_t
+dc1394_juju_capture_dequeue (platform_camera_t * craw,
+        dc1394capture_policy_t policy, dc1394video_frame_t **frame_return)
+{
+    struct juju_frame *f;
+    uint32_t skipped = 0;
+    int err;
+
+    if ( (policy<DC1394_CAPTURE_POLICY_MIN) || (policy>DC1394_CAPTURE_POLICY_MAX) )
+        return DC1394_INVALID_CAPTURE_POLICY;
+
+    if (craw->mc)
+        return juju_mc_capture_dequeue (craw, policy, frame_return);
+
+    // default: return NULL in case of failures or lack of frames
+    *frame_return=NULL;
+
+    // pick up all the frames that have already arrived
+    if (policy == DC1394_CAPTURE_POLICY_LATEST) {
+        while ((err = read_iso_event (craw, 0)) > 0)
+            ;
+        if (err < 0)
+            return DC1394_FAILURE;
+    }
+
+    while (craw->ready_count == 0) {
+        err = read_iso_event (craw,
+                (policy == DC1394_CAPTURE_POLICY_POLL) ? 0 : -1);
+        if (err < 0)
+            return DC1394_FAILURE;
+        if (err == 0)
+            return DC1394_SUCCESS;
+    }
+
+    // give the older frames back to the kernel, they are all complete
+    if (policy == DC1394_CAPTURE_POLICY_LATEST) {
+        while (craw->ready_count > 1) {
+            f = pop_ready (craw);
+            err = queue_frame (craw, f->frame.id);
+            DC1394_ERR_RTN(err, "Failed to queue skipped frame");
+            skipped++;
+        }
     }
 
+    f = pop_ready (craw);
+    f->frame.frames_behind = craw->ready_count;
+    if (policy == DC1394_CAPTURE_POLICY_LATEST)
+        capture_account_skipped (craw->camera, &f->frame, skipped);
+
     *frame_return = &f->frame;
 
     return DC1394_SUCCESS;
 }
 
+/* Waits until a frame handed out early with partial delivery has been
+ * completely written by the DMA. */
+static dc1394error_t
+complete_frame (platform_camera_t * craw, struct juju_frame * f)
+{
+    while (f->packets_received < f->frame.packets_per_frame) {
+        if (read_iso_event (craw, -1) < 0)
+            return DC1394_FAILURE;
+    }
+    return DC1394_SUCCESS;
+}
+
 dc1394error_t
 dc1394_juju_capture_enqueue (platform_camera_t * craw,
         dc1394video_frame_t * frame)
 {
     dc1394camera_t * camera = craw->camera;
+    struct juju_frame * f = (struct juju_frame *) frame;
     int err;
 
     err = DC1394_INVALID_ARGUMENT_VALUE;
     if (frame->camera != camera)
         DC1394_ERR_RTN(err, "camera does not match frame's camera");
 
+    // a retained frame goes back with dc1394_capture_release()
+    if (f->leased)
+        return DC1394_SUCCESS;
+
+    if (craw->mc)
+        return juju_mc_capture_enqueue (craw, frame);
+
+    err = complete_frame (craw, f);
+    DC1394_ERR_RTN(err, "Failed to complete frame");
+
     err = queue_frame (craw, frame->id);
     DC1394_ERR_RTN(err, "Failed to queue frame");
 
@@ -409,6 +772,102 @@ dc1394_juju_capture_enqueue (platform_camera_t * craw,
 int
 dc1394_juju_capture_get_fileno (platform_camera_t * craw)
 {
+    if (craw->mc)
+        return craw->notify_fd[0];
     return craw->iso_fd;
 }
 
+dc1394bool_t
+dc1394_juju_capture_is_frame_corrupt (platform_camera_t * craw,
+        dc1394video_frame_t * frame)
+{
+    struct juju_frame * f = (struct juju_frame *) frame;
+
+    if (f->corrupt)
+        return DC1394_TRUE;
+
+    return DC1394_FALSE;
+}
+
+
+dc1394error_t
+dc1394_juju_capture_set_partial_delivery (platform_camera_t * craw,
+        uint32_t packets_per_band)
+{
+    if (craw->capture_is_set > 0)
+        return DC1394_CAPTURE_IS_RUNNING;
+
+    craw->band_packets = packets_per_band;
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_juju_capture_wait_rows (platform_camera_t * craw,
+        dc1394video_frame_t * frame, uint32_t rows,
+        dc1394capture_policy_t policy)
+{
+    int err;
+
+    if ( (policy<DC1394_CAPTURE_POLICY_MIN) || (policy>DC1394_CAPTURE_POLICY_MAX) )
+        return DC1394_INVALID_CAPTURE_POLICY;
+
+    if (frame->camera != craw->camera)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+
+    if (rows > frame->size[1])
+        rows = frame->size[1];
+
+    while (frame->rows_available < rows) {
+        err = read_iso_event (craw,
+                (policy == DC1394_CAPTURE_POLICY_POLL) ? 0 : -1);
+        if (err < 0)
+            return DC1394_FAILURE;
+        if (err == 0)
+            break;
+    }
+
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_juju_capture_retain (platform_camera_t * craw,
+        dc1394video_frame_t * frame)
+{
+    struct juju_frame * f = (struct juju_frame *) frame;
+    dc1394error_t err;
+    int index;
+
+    if (frame->camera != craw->camera || f->leased)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+
+    if (craw->spare_count == 0)
+        return DC1394_CAPTURE_NO_SPARE_BUFFER;
+
+    index = craw->spare[--craw->spare_count];
+    err = queue_frame (craw, index);
+    if (err != DC1394_SUCCESS) {
+        craw->spare_count++;
+        return err;
+    }
+
+    f->leased = 1;
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_juju_capture_release (platform_camera_t * craw,
+        dc1394video_frame_t * frame)
+{
+    struct juju_frame * f = (struct juju_frame *) frame;
+    dc1394error_t err;
+
+    if (frame->camera != craw->camera || !f->leased)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+
+    err = complete_frame (craw, f);
+    DC1394_ERR_RTN(err, "Failed to complete frame");
+
+    f->leased = 0;
+    craw->spare[craw->spare_count++] = frame->id;
+    return DC1394_SUCCESS;
+}
@@ -66,11 +66,14 @@ dc1394_juju_new (void)
     }
 
     platform_t * p = calloc (1, sizeof (platform_t));
+    if (p)
+        pthread_mutex_init (&p->mc_lock, NULL);
     return p;
 }
 static void
 dc1394_juju_free (platform_t * p)
 {
+    pthread_mutex_destroy (&p->mc_lock);
     free (p);
 }
 
@@ -185,23 +188,29 @@ add_iso_resource (platform_camera_t *cam)
     juju_iso_info *res = calloc (1, sizeof (juju_iso_info));
     if (!res)
         return NULL;
+    pthread_mutex_lock (&cam->lock);
     res->next = cam->iso_resources;
     cam->iso_resources = res;
+    pthread_mutex_unlock (&cam->lock);
     return res;
 }
 
 static void
 remove_iso_resource (platform_camera_t *cam, juju_iso_info * res)
 {
-    juju_iso_info **ptr = &cam->iso_resources;
+    juju_iso_info **ptr;
+
+    pthread_mutex_lock (&cam->lock);
+    ptr = &cam->iso_resources;
     while (*ptr) {
         if (*ptr == res) {
             *ptr = res->next;
             free (res);
-            return;
+            break;
         }
         ptr = &(*ptr)->next;
     }
+    pthread_mutex_unlock (&cam->lock);
 }
 
 static platform_camera_t *
@@ -232,6 +241,13 @@ dc1394_juju_camera_new (platform_t * p, platform_device_t * device, uint32_t uni
 
     camera = calloc (1, sizeof (platform_camera_t));
     camera->fd = fd;
+    camera->platform = p;
+    camera->kernel_version = get_info.version;
+    camera->card = get_info.card;
+    camera->mc_frame = -1;
+    camera->max_in_flight = JUJU_MAX_IN_FLIGHT;
+    pthread_mutex_init (&camera->lock, NULL);
+    pthread_cond_init (&camera->event_cond, NULL);
     camera->generation = reset.generation;
     camera->node_id = reset.node_id;
     strcpy (camera->filename, device->filename);
@@ -248,6 +264,8 @@ static void dc1394_juju_camera_free (platform_camera_t * cam)
     while (cam->iso_resources)
         remove_iso_resource (cam, cam->iso_resources);
     close (cam->fd);
+    pthread_cond_destroy (&cam->event_cond);
+    pthread_mutex_destroy (&cam->lock);
     free (cam);
 }
 
@@ -267,30 +285,50 @@ dc1394_juju_camera_print_info (platform_camera_t * camera, FILE *fd)
 
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
 
-typedef struct _juju_response_info {
-    int got_response;
-    uint32_t rcode;
-    uint32_t *data;
-    int num_quads;
-    int actual_num_quads;
-} juju_response_info;
+/* Takes the slot of a transaction whose waiter gave up while its request
+ * was in flight: the response that comes later is dropped */
+static juju_transaction abandoned_transaction;
 
+static void release_slot (platform_camera_t * cam, int slot);
+static int send_transaction (platform_camera_t * cam, juju_transaction * t);
+static void complete_transaction (platform_camera_t * cam, juju_transaction * t,
+        uint32_t rcode, const uint32_t * data, uint32_t length);
+
+/*
+ * Reads and dispatches one event, with cam->lock held.  Several threads may
+ * wait for their own transactions on the same camera: the first one to get
+ * here becomes the event reader and drops the lock while it blocks in
+ * read(), so that the others can keep sending requests.  The others sleep
+ * until the reader has dispatched an event, then check on their
+ * transaction again, and one of them takes over reading once the reader
+ * is done.  Returns -1 if the read failed.
+ */
 static int
 juju_handle_event (platform_camera_t * cam)
 {
     union {
         struct {
             struct fw_cdev_event_response r;
-            __u32 buffer[cam->max_response_quads];
+            __u32 buffer[JUJU_MAX_RESPONSE_QUADS];
         } response;
         struct fw_cdev_event_bus_reset reset;
         struct fw_cdev_event_iso_resource resource;
     } u;
-    int len, i;
-    juju_response_info *resp_info;
+    int len;
+    uint64_t slot;
     juju_iso_info *iso_info;
 
+    if (cam->event_reader) {
+        pthread_cond_wait (&cam->event_cond, &cam->lock);
+        return 0;
+    }
+
+    cam->event_reader = 1;
+    pthread_mutex_unlock (&cam->lock);
     len = read (cam->fd, &u, sizeof u);
+    pthread_mutex_lock (&cam->lock);
+    cam->event_reader = 0;
+    pthread_cond_broadcast (&cam->event_cond);
     if (len < 0) {
         dc1394_log_error("juju: Read failed: %m");
         return -1;
@@ -305,26 +343,21 @@ juju_handle_event (platform_camera_t * cam)
         break;
 
     case FW_CDEV_EVENT_RESPONSE:
-        if (!u.response.r.closure) {
+        slot = u.response.r.closure - 1;
+        if (u.response.r.closure == 0 || slot >= JUJU_MAX_IN_FLIGHT ||
+                !cam->pending[slot]) {
             dc1394_log_warning ("juju: Unsolicited response, rcode %x len %d",
                     u.response.r.rcode, u.response.r.length);
             break;
         }
-        resp_info = u64_to_ptr(u.response.r.closure);
-        resp_info->rcode = u.response.r.rcode;
-        resp_info->actual_num_quads = u.response.r.length/4;
-        resp_info->got_response = 1;
-        if (resp_info->rcode || !resp_info->data)
-            break;
-        if (cam->max_response_quads < resp_info->actual_num_quads) {
-            dc1394_log_error ("juju: read buffer too small, have %d needed %d",
-                    cam->max_response_quads, resp_info->actual_num_quads);
+        if (cam->pending[slot] == &abandoned_transaction) {
+            dc1394_log_debug ("juju: Response to an abandoned transaction, "
+                    "rcode %x", u.response.r.rcode);
+            release_slot (cam, slot);
             break;
         }
-
-        len = MIN(resp_info->actual_num_quads, resp_info->num_quads);
-        for (i = 0; i < len; i++)
-            resp_info->data[i] = ntohl (u.response.r.data[i]);
+        complete_transaction (cam, cam->pending[slot],
+                u.response.r.rcode, u.response.r.data, u.response.r.length);
         break;
 
     case FW_CDEV_EVENT_ISO_RESOURCE_ALLOCATED:
@@ -372,75 +405,251 @@ juju_handle_event (platform_camera_t * cam)
     return 0;
 }
 
-static dc1394error_t
-do_transaction(platform_camera_t * cam, int tcode, uint64_t offset,
-        const uint32_t * in, uint32_t * out, uint32_t num_quads)
+/*
+ * Asynchronous transactions.  Each transaction takes a slot of the pending
+ * table, sent as its closure, so that up to max_in_flight of them can wait
+ * for their response at once; the responses are matched to the slots in
+ * juju_handle_event(), which drops those of abandoned transactions.  When the
+ * camera answers busy, the number of requests kept in flight shrinks to
+ * what it manages to serve, and grows back by one each time it has served
+ * JUJU_IN_FLIGHT_GROW transactions in a row.
+ */
+
+static int
+send_transaction (platform_camera_t * cam, juju_transaction * t)
 {
     struct fw_cdev_send_request request;
-    juju_response_info resp;
-    int i, len;
-    uint32_t in_buffer[in ? num_quads : 0];
-    int retry = 300;
+    int iotype = FW_CDEV_IOC_SEND_REQUEST;
+
+    memset (&request, 0, sizeof request);
+    request.closure = t->slot + 1;
+    request.offset = CONFIG_ROM_BASE + t->offset;
+    request.data = ptr_to_u64(t->payload);
+    request.length = t->num_quads * 4;
+    request.tcode = t->tcode;
+    request.generation = cam->generation;
+
+    if (cam->broadcast_enabled && (t->tcode == TCODE_WRITE_BLOCK_REQUEST ||
+                t->tcode == TCODE_WRITE_QUADLET_REQUEST))
+        iotype = FW_CDEV_IOC_SEND_BROADCAST_REQUEST;
+
+    if (ioctl (cam->fd, iotype, &request) < 0) {
+        dc1394_log_error("juju: Send request failed: %m");
+        return -1;
+    }
+    return 0;
+}
+
+static void
+release_slot (platform_camera_t * cam, int slot)
+{
+    cam->pending[slot] = NULL;
+    cam->in_flight--;
+}
+
+static void
+finish_transaction (platform_camera_t * cam, juju_transaction * t,
+        dc1394error_t err)
+{
+    free (t->payload);
+    t->payload = NULL;
+    t->err = err;
+    t->done = 1;
+    transaction_account (cam->camera, &t->retry, t->rcode, err);
+    release_slot (cam, t->slot);
+    if (err == DC1394_SUCCESS && cam->max_in_flight < JUJU_MAX_IN_FLIGHT &&
+            ++cam->served_in_a_row >= JUJU_IN_FLIGHT_GROW) {
+        cam->max_in_flight++;
+        cam->served_in_a_row = 0;
+        dc1394_log_debug("juju: camera keeping up, allowing %d requests "
+                "in flight", cam->max_in_flight);
+    }
+    if (t->callback)
+        t->callback (t, t->user);
+}
 
-    for (i = 0; in && i < num_quads; i++)
-        in_buffer[i] = htonl (in[i]);
+static void
+complete_transaction (platform_camera_t * cam, juju_transaction * t,
+        uint32_t rcode, const uint32_t * data, uint32_t length)
+{
+    uint32_t i, len;
+    int wait, slot;
 
-    resp.data = out;
-    resp.num_quads = out ? num_quads : 0;
-    cam->max_response_quads = resp.num_quads;
+    t->rcode = rcode;
+    t->actual_num_quads = length / 4;
 
-    request.closure = ptr_to_u64(&resp);
-    request.offset = CONFIG_ROM_BASE + offset;
-    request.data = ptr_to_u64(in_buffer);
-    request.length = num_quads * 4;
-    request.tcode = tcode;
+    if (rcode == 0) {
+        if (t->out) {
+            if (t->num_quads != t->actual_num_quads)
+                dc1394_log_warning("juju: Expected response len %d, got %d",
+                        t->num_quads, t->actual_num_quads);
+            len = MIN(t->actual_num_quads, t->num_quads);
+            for (i = 0; i < len; i++)
+                t->out[i] = ntohl (data[i]);
+        }
+        finish_transaction (cam, t, DC1394_SUCCESS);
+        return;
+    }
 
-    while (retry > 0) {
-        int retval;
+    if (rcode != RCODE_BUSY
+            && rcode != RCODE_CONFLICT_ERROR
+            && rcode != RCODE_GENERATION) {
+        dc1394_log_debug ("juju: Response error, rcode 0x%x", rcode);
+        finish_transaction (cam, t, DC1394_FAILURE);
+        return;
+    }
 
-        request.generation = cam->generation;
+    if (rcode == RCODE_BUSY)
+        cam->served_in_a_row = 0;
+    if (rcode == RCODE_BUSY && cam->max_in_flight > 1) {
+        cam->max_in_flight = cam->in_flight > 1 ? cam->in_flight - 1 : 1;
+        dc1394_log_debug("juju: camera busy, keeping %d requests in flight",
+                cam->max_in_flight);
+    }
 
-        int iotype = FW_CDEV_IOC_SEND_REQUEST;
-        if (cam->broadcast_enabled && (tcode == TCODE_WRITE_BLOCK_REQUEST ||
-                    tcode == TCODE_WRITE_QUADLET_REQUEST))
-            iotype = FW_CDEV_IOC_SEND_BROADCAST_REQUEST;
+    /* retry if we get any of the rcodes listed above */
+    wait = transaction_retry_next (&t->retry, rcode);
+    if (wait < 0) {
+        dc1394_log_error("juju: Max retries for tcode 0x%x, offset %"PRIx64,
+                t->tcode, t->offset);
+        finish_transaction (cam, t, DC1394_FAILURE);
+        return;
+    }
+    dc1394_log_debug("juju: retry rcode 0x%x tcode 0x%x offset %"PRIx64,
+            rcode, t->tcode, t->offset);
+    /* the other threads go on while this one backs off, and the waiter
+     * may give up on the transaction meanwhile */
+    slot = t->slot;
+    pthread_mutex_unlock (&cam->lock);
+    usleep (wait);
+    pthread_mutex_lock (&cam->lock);
+    if (cam->pending[slot] != t) {
+        release_slot (cam, slot);
+        return;
+    }
+    if (send_transaction (cam, t) < 0) {
+        t->rcode = TRANSACTION_RCODE_UNKNOWN;
+        finish_transaction (cam, t, DC1394_FAILURE);
+    }
+}
 
-        len = ioctl (cam->fd, iotype, &request);
-        if (len < 0) {
-            dc1394_log_error("juju: Send request failed: %m");
-            return DC1394_FAILURE;
-        }
+/* Sends a transaction without waiting for its response, once fewer than
+ * max_in_flight transactions are pending.  The transaction must stay valid
+ * until it is done.  Any thread may submit and wait for transactions. */
+dc1394error_t
+juju_transaction_submit (platform_camera_t * cam, juju_transaction * t)
+{
+    uint32_t i;
 
-        resp.got_response = 0;
-        while (!resp.got_response)
-            if ((retval = juju_handle_event (cam)) < 0)
-                return retval;
+    if (t->out && t->num_quads > JUJU_MAX_RESPONSE_QUADS) {
+        dc1394_log_error("juju: Read of %d quadlets is too large", t->num_quads);
+        return DC1394_INVALID_ARGUMENT_VALUE;
+    }
 
-        if (resp.rcode == 0) {
-            if (resp.num_quads != resp.actual_num_quads)
-                dc1394_log_warning("juju: Expected response len %d, got %d",
-                        resp.num_quads, resp.actual_num_quads);
-            return DC1394_SUCCESS;
+    t->done = 0;
+    t->err = DC1394_SUCCESS;
+    t->rcode = 0;
+    transaction_retry_start (cam->camera, &t->retry, JUJU_MAX_ATTEMPTS);
+    t->payload = NULL;
+    if (t->in) {
+        t->payload = malloc (t->num_quads * 4);
+        if (!t->payload)
+            return DC1394_MEMORY_ALLOCATION_FAILURE;
+        for (i = 0; i < t->num_quads; i++)
+            t->payload[i] = htonl (t->in[i]);
+    }
+
+    pthread_mutex_lock (&cam->lock);
+    while (cam->in_flight >= cam->max_in_flight)
+        if (juju_handle_event (cam) < 0) {
+            pthread_mutex_unlock (&cam->lock);
+            free (t->payload);
+            t->payload = NULL;
+            return DC1394_FAILURE;
         }
 
-        if (resp.rcode != RCODE_BUSY
-                && resp.rcode != RCODE_CONFLICT_ERROR
-                && resp.rcode != RCODE_GENERATION) {
-            dc1394_log_debug ("juju: Response error, rcode 0x%x",
-                    resp.rcode);
+    // used slots and in_flight are kept equal, so one is free
+    for (i = 0; cam->pending[i]; i++)
+        ;
+    cam->pending[i] = t;
+    t->slot = i;
+    cam->in_flight++;
+    if (send_transaction (cam, t) < 0) {
+        t->rcode = TRANSACTION_RCODE_UNKNOWN;
+        finish_transaction (cam, t, DC1394_FAILURE);
+        pthread_mutex_unlock (&cam->lock);
+        return DC1394_FAILURE;
+    }
+    pthread_mutex_unlock (&cam->lock);
+    return DC1394_SUCCESS;
+}
+
+/* Handles events until the transaction is done, and returns its status.
+ * If reading the events fails, the transaction is abandoned so that the
+ * caller may release it: its callback is not called. */
+dc1394error_t
+juju_transaction_wait (platform_camera_t * cam, juju_transaction * t)
+{
+    dc1394error_t err;
+
+    pthread_mutex_lock (&cam->lock);
+    while (!t->done)
+        if (juju_handle_event (cam) < 0) {
+            if (!t->done) {
+                cam->pending[t->slot] = &abandoned_transaction;
+                free (t->payload);
+                t->payload = NULL;
+            }
+            pthread_mutex_unlock (&cam->lock);
             return DC1394_FAILURE;
         }
+    err = t->err;
+    pthread_mutex_unlock (&cam->lock);
+    return err;
+}
+
+/* Runs a batch of transactions, keeping as many of them in flight as the
+ * camera accepts.  Returns the first error, once all of them are done. */
+dc1394error_t
+juju_transaction_run (platform_camera_t * cam, juju_transaction * t,
+        uint32_t num)
+{
+    dc1394error_t err, ret = DC1394_SUCCESS;
+    uint32_t i, submitted;
 
-        /* retry if we get any of the rcodes listed above */
-        dc1394_log_debug("juju: retry rcode 0x%x tcode 0x%x offset %"PRIx64,
-                resp.rcode, tcode, offset);
-        usleep (DC1394_SLOW_DOWN);
-        retry--;
+    for (submitted = 0; submitted < num; submitted++) {
+        err = juju_transaction_submit (cam, t + submitted);
+        if (err != DC1394_SUCCESS) {
+            ret = err;
+            break;
+        }
     }
+    for (i = 0; i < submitted; i++) {
+        err = juju_transaction_wait (cam, t + i);
+        if (err != DC1394_SUCCESS && ret == DC1394_SUCCESS)
+            ret = err;
+    }
+    return ret;
+}
 
-    dc1394_log_error("juju: Max retries for tcode 0x%x, offset %"PRIx64,
-            tcode, offset);
-    return DC1394_FAILURE;
+static dc1394error_t
+do_transaction(platform_camera_t * cam, int tcode, uint64_t offset,
+        const uint32_t * in, uint32_t * out, uint32_t num_quads)
+{
+    juju_transaction t;
+    dc1394error_t err;
+
+    memset (&t, 0, sizeof t);
+    t.tcode = tcode;
+    t.offset = offset;
+    t.in = in;
+    t.out = out;
+    t.num_quads = num_quads;
+
+    err = juju_transaction_submit (cam, &t);
+    if (err != DC1394_SUCCESS)
+        return err;
+    return juju_transaction_wait (cam, &t);
 }
 
 static dc1394error_t
@@ -470,6 +679,106 @@ dc1394_juju_camera_write (platform_camera_t * cam, uint64_t offset, const uint32
     return do_transaction(cam, tcode, offset, quads, NULL, num_quads);
 }
 
+static dc1394error_t
+juju_transfer_vector (platform_camera_t * cam, const dc1394register_io_t * ios,
+        uint32_t num, int write)
+{
+    juju_transaction * t;
+    dc1394error_t err = DC1394_SUCCESS;
+    uint32_t i, j, start;
+
+    t = calloc (num, sizeof *t);
+    if (!t)
+        return DC1394_MEMORY_ALLOCATION_FAILURE;
+    for (i = 0; i < num; i++) {
+        t[i].offset = ios[i].offset;
+        t[i].num_quads = ios[i].num_regs;
+        if (write) {
+            t[i].tcode = ios[i].num_regs > 1 ? TCODE_WRITE_BLOCK_REQUEST :
+                TCODE_WRITE_QUADLET_REQUEST;
+            t[i].in = ios[i].value;
+        }
+        else {
+            t[i].tcode = ios[i].num_regs > 1 ? TCODE_READ_BLOCK_REQUEST :
+                TCODE_READ_QUADLET_REQUEST;
+            t[i].out = ios[i].value;
+        }
+    }
+
+    /* A register written twice is written in order: the second write waits
+     * for the batch holding the first one to complete */
+    for (start = 0, i = 1; i <= num && err == DC1394_SUCCESS; i++) {
+        int repeated = 0;
+        for (j = start; write && i < num && j < i; j++)
+            if (ios[j].offset == ios[i].offset)
+                repeated = 1;
+        if (i < num && !repeated)
+            continue;
+        err = juju_transaction_run (cam, t + start, i - start);
+        start = i;
+    }
+    free (t);
+    return err;
+}
+
+static dc1394error_t
+dc1394_juju_camera_read_vector (platform_camera_t * cam,
+        dc1394register_io_t * ios, uint32_t num)
+{
+    return juju_transfer_vector (cam, ios, num, 0);
+}
+
+static dc1394error_t
+dc1394_juju_camera_write_vector (platform_camera_t * cam,
+        const dc1394register_io_t * ios, uint32_t num)
+{
+    return juju_transfer_vector (cam, ios, num, 1);
+}
+
+static void
+group_write_done (juju_transaction * t, void * user)
+{
+    *(uint64_t *) user = capture_get_time_usec ();
+}
+
+/* Sends the same write to several cameras before waiting for any of them,
+ * and notes when each one completed */
+static void
+dc1394_juju_camera_write_group (platform_camera_t ** cams,
+        const uint64_t * offsets, uint32_t num, uint32_t value,
+        dc1394error_t * errs, uint64_t * times)
+{
+    juju_transaction * t;
+    uint32_t i;
+
+    t = calloc (num, sizeof *t);
+    if (!t) {
+        for (i = 0; i < num; i++) {
+            errs[i] = dc1394_juju_camera_write (cams[i], offsets[i], &value, 1);
+            times[i] = capture_get_time_usec ();
+        }
+        return;
+    }
+
+    for (i = 0; i < num; i++) {
+        t[i].tcode = TCODE_WRITE_QUADLET_REQUEST;
+        t[i].offset = offsets[i];
+        t[i].in = &value;
+        t[i].num_quads = 1;
+        t[i].callback = group_write_done;
+        t[i].user = &times[i];
+        times[i] = 0;
+        errs[i] = juju_transaction_submit (cams[i], &t[i]);
+    }
+    for (i = 0; i < num; i++) {
+        if (errs[i] == DC1394_SUCCESS)
+            errs[i] = juju_transaction_wait (cams[i], &t[i]);
+        if (times[i] == 0)
+            times[i] = capture_get_time_usec ();
+    }
+    free (t);
+}
+
 static dc1394error_t
 dc1394_juju_reset_bus (platform_camera_t * cam)
 {
@@ -493,6 +802,13 @@ dc1394_juju_camera_get_node(platform_camera_t *cam, uint32_t *node,
     return DC1394_SUCCESS;
 }
 
+static dc1394error_t
+dc1394_juju_camera_get_bus(platform_camera_t *cam, uint32_t *bus)
+{
+    *bus = cam->card;
+    return DC1394_SUCCESS;
+}
+
 static dc1394error_t
 dc1394_juju_read_cycle_timer (platform_camera_t * cam,
         uint32_t * cycle_timer, uint64_t * local_time)
@@ -576,10 +892,13 @@ juju_iso_allocate (platform_camera_t *cam, uint64_t allowed_channels,
             "handle %d, chan 0x%"PRIx64", bw %d", request.handle,
             request.channels, request.bandwidth);
 
-    int ret;
-    while (!res->got_alloc)
-        if ((ret = juju_handle_event (cam)) < 0)
-            return ret;
+    int ret = 0;
+    pthread_mutex_lock (&cam->lock);
+    while (!res->got_alloc && ret == 0)
+        ret = juju_handle_event (cam);
+    pthread_mutex_unlock (&cam->lock);
+    if (ret < 0)
+        return ret;
 
     if (allowed_channels && res->channel < 0) {
         remove_iso_resource (cam, res);
@@ -613,10 +932,13 @@ juju_iso_deallocate (platform_camera_t *cam, juju_iso_info * res)
         return DC1394_FAILURE;
     }
 
-    int ret;
-    while (!res->got_dealloc)
-        if ((ret = juju_handle_event (cam)) < 0)
-            return ret;
+    int ret = 0;
+    pthread_mutex_lock (&cam->lock);
+    while (!res->got_dealloc && ret == 0)
+        ret = juju_handle_event (cam);
+    pthread_mutex_unlock (&cam->lock);
+    if (ret < 0)
+        return ret;
 
     remove_iso_resource (cam, res);
     return DC1394_SUCCESS;
@@ -660,10 +982,14 @@ juju_dispatch = {
 
     .camera_read = dc1394_juju_camera_read,
     .camera_write = dc1394_juju_camera_write,
+    .camera_read_vector = dc1394_juju_camera_read_vector,
+    .camera_write_vector = dc1394_juju_camera_write_vector,
+    .camera_write_group = dc1394_juju_camera_write_group,
 
     .reset_bus = dc1394_juju_reset_bus,
     .camera_print_info = dc1394_juju_camera_print_info,
     .camera_get_node = dc1394_juju_camera_get_node,
+    .camera_get_bus = dc1394_juju_camera_get_bus,
     .read_cycle_timer = dc1394_juju_read_cycle_timer,
     .set_broadcast = dc1394_juju_set_broadcast,
     .get_broadcast = dc1394_juju_get_broadcast,
@@ -673,6 +999,12 @@ juju_dispatch = {
     .capture_dequeue = dc1394_juju_capture_dequeue,
     .capture_enqueue = dc1394_juju_capture_enqueue,
     .capture_get_fileno = dc1394_juju_capture_get_fileno,
+    .capture_is_frame_corrupt = dc1394_juju_capture_is_frame_corrupt,
+    .capture_retain = dc1394_juju_capture_retain,
+    .capture_release = dc1394_juju_capture_release,
+    .capture_set_partial_delivery = dc1394_juju_capture_set_partial_delivery,
+    .capture_wait_rows = dc1394_juju_capture_wait_rows,
+    .capture_reconfigure = dc1394_juju_capture_reconfigure,
 
     //.iso_allocate_channel = dc1394_juju_iso_allocate_channel,
 };
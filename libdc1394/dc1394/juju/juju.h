@@ -24,14 +24,18 @@
 #ifndef __DC1394_JUJU_H__
 #define __DC1394_JUJU_H__
 
+#include <pthread.h>
 #include "firewire-cdev.h"
 #include "config.h"
 #include "internal.h"
 #include "register.h"
 #include "offsets.h"
 
+struct _juju_mc_context;
+
 struct _platform_t {
-    int dummy;
+    struct _juju_mc_context * mc_contexts;
+    pthread_mutex_t mc_lock;
 };
 
 typedef struct _juju_iso_info {
@@ -43,12 +47,54 @@ typedef struct _juju_iso_info {
     struct _juju_iso_info *next;
 } juju_iso_info;
 
+/* Attempts per register transaction unless the retry policy sets them */
+#define JUJU_MAX_ATTEMPTS 300
+
+/* Number of register transactions kept in flight at most */
+#define JUJU_MAX_IN_FLIGHT 8
+/* Transactions served in a row before one more is kept in flight again */
+#define JUJU_IN_FLIGHT_GROW 32
+
+/* Largest response read, the biggest asynchronous payload (S3200) */
+#define JUJU_MAX_RESPONSE_QUADS 1024
+
+/* An asynchronous register transaction.  The caller fills in the request
+ * and keeps the struct valid until done is set; the callback, if any, is
+ * called from the event loop when it completes, with the lock of the
+ * camera held, and must not start other transactions. */
+typedef struct _juju_transaction {
+    int tcode;
+    uint64_t offset;            /* relative to CONFIG_ROM_BASE */
+    const uint32_t * in;        /* data to write, in host order */
+    uint32_t * out;             /* room for the data read, in host order */
+    uint32_t num_quads;
+    void (*callback)(struct _juju_transaction *, void *);
+    void * user;
+
+    int done;
+    dc1394error_t err;
+    uint32_t rcode;
+    uint32_t actual_num_quads;
+    transaction_retry_t retry;
+    uint32_t * payload;         /* the data to write, in bus order */
+    int slot;                   /* index in the pending table while in flight */
+} juju_transaction;
+
 struct _platform_camera_t {
     int fd;
     char filename[32];
+    platform_t * platform;
+    int kernel_version;
+    uint32_t card;
     int generation;
     uint32_t node_id;
-    int max_response_quads;
+    pthread_mutex_t lock;       /* protects the transactions and events below */
+    pthread_cond_t event_cond;  /* signalled when an event was dispatched */
+    int event_reader;           /* a thread is reading events from fd */
+    int in_flight;              /* transactions waiting for their response */
+    int max_in_flight;
+    int served_in_a_row;        /* transactions done without a busy answer */
+    juju_transaction * pending[JUJU_MAX_IN_FLIGHT]; /* in flight, by slot */
     juju_iso_info *iso_resources;
     uint8_t header_size;
     uint8_t broadcast_enabled;
@@ -62,7 +108,17 @@ struct _platform_camera_t {
     size_t buffer_size;
     uint32_t flags;
     unsigned int num_frames;
-    int current;
+    int *queue;                 /* frames queued to the kernel, oldest first */
+    unsigned int queue_head, queue_count;
+    int *ready;                 /* frames with data not yet dequeued */
+    unsigned int ready_head, ready_count;
+    int *spare;                 /* frames that can replace a retained frame */
+    unsigned int spare_count;
+    uint32_t band_packets;      /* packets per interrupt, 0 for one per frame */
+
+    struct _juju_mc_context * mc;   /* shared multichannel context, if any */
+    int mc_frame;               /* frame being filled by it, -1 if none */
+    int notify_fd[2];           /* read and write ends, signalled per frame */
 
     unsigned int iso_channel;
     int capture_is_set;
@@ -75,8 +131,45 @@ struct juju_frame {
     dc1394video_frame_t                 frame;
     size_t                         size;
     struct fw_cdev_iso_packet        *packets;
+    int                            corrupt;
+    uint64_t                       queued_time;
+    uint32_t                       packets_received;
+    uint32_t                       last_cycle;
+    int                            leased;
 };
 
+/* Receives the channels of several cameras on the same card with a single
+ * iso context, and sorts their packets into the frames of each camera. */
+typedef struct _juju_mc_context {
+    platform_t * platform;
+    uint32_t card;
+    int fd;
+    uint32_t handle;
+    unsigned char * buffer;
+    size_t buffer_size;
+    uint64_t read_pos;          /* stream position of the next packet */
+    uint64_t done_pos;          /* stream position completed by the kernel */
+    uint64_t requeue_pos;       /* stream position of the first chunk not given back */
+    uint64_t channels;
+    platform_camera_t * cameras[64];
+    int num_cameras;
+    unsigned char * packet;     /* packets wrapping around the buffer end */
+    pthread_t thread;
+    int wake_pipe[2];
+    pthread_mutex_t lock;       /* protects the cameras and their frame rings */
+    struct _juju_mc_context * next;
+} juju_mc_context;
+
+dc1394error_t
+juju_transaction_submit (platform_camera_t * cam, juju_transaction * t);
+
+dc1394error_t
+juju_transaction_wait (platform_camera_t * cam, juju_transaction * t);
+
+dc1394error_t
+juju_transaction_run (platform_camera_t * cam, juju_transaction * t,
+        uint32_t num);
+
 dc1394error_t
 dc1394_juju_capture_setup(platform_camera_t *craw, uint32_t num_dma_buffers,
         uint32_t flags);
@@ -95,6 +188,45 @@ dc1394_juju_capture_enqueue (platform_camera_t * craw,
 int
 dc1394_juju_capture_get_fileno (platform_camera_t * craw);
 
+dc1394bool_t
+dc1394_juju_capture_is_frame_corrupt (platform_camera_t * craw,
+        dc1394video_frame_t * frame);
+
+dc1394error_t
+dc1394_juju_capture_retain (platform_camera_t * craw,
+        dc1394video_frame_t * frame);
+
+dc1394error_t
+dc1394_juju_capture_release (platform_camera_t * craw,
+        dc1394video_frame_t * frame);
+
+dc1394error_t
+dc1394_juju_capture_set_partial_delivery (platform_camera_t * craw,
+        uint32_t packets_per_band);
+
+dc1394error_t
+dc1394_juju_capture_reconfigure (platform_camera_t * craw);
+
+dc1394error_t
+dc1394_juju_capture_wait_rows (platform_camera_t * craw,
+        dc1394video_frame_t * frame, uint32_t rows,
+        dc1394capture_policy_t policy);
+
+dc1394error_t
+juju_mc_capture_setup (platform_camera_t * craw, uint32_t num_dma_buffers,
+        dc1394video_frame_t * proto);
+
+dc1394error_t
+juju_mc_capture_stop (platform_camera_t * craw);
+
+dc1394error_t
+juju_mc_capture_dequeue (platform_camera_t * craw,
+        dc1394capture_policy_t policy, dc1394video_frame_t **frame_return);
+
+dc1394error_t
+juju_mc_capture_enqueue (platform_camera_t * craw,
+        dc1394video_frame_t * frame);
+
 dc1394error_t
 juju_iso_allocate (platform_camera_t *cam, uint64_t allowed_channels,
         int bandwidth_units, juju_iso_info **out);
@@ -0,0 +1,626 @@
+/*
+ * 1394-Based Digital Camera Control Library
+ *
+ * Juju backend for dc1394: multichannel reception
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Cameras set up with DC1394_CAPTURE_FLAGS_MULTICHANNEL on the same card
+ * share one multichannel receive context.  The controller writes the packets
+ * of all their channels one after the other into a single buffer, which is
+ * queued to the kernel as a ring of chunks.  A receive thread walks the
+ * packets as the chunks complete, copies their payload into the frames of
+ * the camera that owns the channel, and signals each camera through its own
+ * notification descriptor when one of its frames is complete. */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <poll.h>
+#include <endian.h>
+#include <inttypes.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+#include "juju/juju.h"
+
+#define ptr_to_u64(p) ((__u64)(unsigned long)(p))
+
+/* The receive buffer is queued as MC_NUM_CHUNKS chunks of MC_CHUNK_SIZE
+ * bytes, each completing with an interrupt. */
+#define MC_CHUNK_SIZE  (32 * 1024)
+#define MC_NUM_CHUNKS  128
+#define MC_MAX_PACKET  (4 + 4096 + 4)
+
+static dc1394error_t
+open_notify_fd (platform_camera_t * craw)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    int fd = eventfd (0, EFD_NONBLOCK);
+    if (fd >= 0) {
+        craw->notify_fd[0] = craw->notify_fd[1] = fd;
+        return DC1394_SUCCESS;
+    }
+#endif
+    if (pipe (craw->notify_fd) < 0) {
+        dc1394_log_error ("juju: Failed to create notification pipe: %m");
+        return DC1394_FAILURE;
+    }
+    fcntl (craw->notify_fd[0], F_SETFL, O_NONBLOCK);
+    fcntl (craw->notify_fd[1], F_SETFL, O_NONBLOCK);
+    return DC1394_SUCCESS;
+}
+
+static void
+close_notify_fd (platform_camera_t * craw)
+{
+    if (craw->notify_fd[0] > 0)
+        close (craw->notify_fd[0]);
+    if (craw->notify_fd[1] > 0 && craw->notify_fd[1] != craw->notify_fd[0])
+        close (craw->notify_fd[1]);
+    craw->notify_fd[0] = craw->notify_fd[1] = 0;
+}
+
+static void
+notify (platform_camera_t * craw)
+{
+    uint64_t one = 1;
+    if (write (craw->notify_fd[1], &one,
+                craw->notify_fd[1] == craw->notify_fd[0] ? 8 : 1) < 0
+            && errno != EAGAIN)
+        dc1394_log_warning ("juju: Failed to signal a frame: %m");
+}
+
+/* Waits up to timeout ms for the notification descriptor and resets it. */
+static void
+drain_notify_fd (platform_camera_t * craw, int timeout)
+{
+    struct pollfd fds[1];
+    unsigned char buf[64];
+
+    fds[0].fd = craw->notify_fd[0];
+    fds[0].events = POLLIN;
+    if (timeout != 0 && poll (fds, 1, timeout) <= 0)
+        return;
+    while (read (craw->notify_fd[0], buf, sizeof buf) > 0 &&
+            craw->notify_fd[0] != craw->notify_fd[1])
+        ;
+}
+
+static uint32_t
+bus_time_to_usec (uint32_t bus)
+{
+    uint32_t sec      = (bus & 0xe000000) >> 25;
+    uint32_t cycles   = (bus & 0x1fff000) >> 12;
+    return sec * 1000000 + cycles * 125;
+}
+
+/* Hands the frame being filled to the user, with ctx->lock held. */
+static void
+deliver_frame (platform_camera_t * craw)
+{
+    struct juju_frame * f = craw->frames + craw->mc_frame;
+    uint32_t ppf = f->frame.packets_per_frame;
+
+    if (f->packets_received < ppf)
+        f->frame.packets_lost += ppf - f->packets_received;
+    if (f->frame.packets_lost > 0) {
+        f->corrupt = 1;
+        dc1394_log_warning ("juju: frame %d is corrupt, %d packets lost",
+                f->frame.id, f->frame.packets_lost);
+    }
+    f->frame.rows_available = f->frame.size[1];
+
+    craw->ready[(craw->ready_head + craw->ready_count) % craw->num_frames] =
+        craw->mc_frame;
+    craw->ready_count++;
+    craw->mc_frame = -1;
+    notify (craw);
+}
+
+/* Sorts one packet into the frames of the camera listening to its channel,
+ * with ctx->lock held.  The sync bit marks the first packet of a frame. */
+static void
+demux_packet (juju_mc_context * ctx, uint32_t header, unsigned char * payload,
+        uint32_t trailer, struct fw_cdev_get_cycle_timer * tm)
+{
+    uint32_t length = header >> 16;
+    uint32_t channel = (header >> 8) & 0x3f;
+    uint32_t sy = header & 0xf;
+    platform_camera_t * craw = ctx->cameras[channel];
+    struct juju_frame * f;
+
+    if (craw == NULL)
+        return;
+
+    if (sy == 1) {
+        if (craw->mc_frame >= 0)
+            deliver_frame (craw);
+        if (craw->queue_count == 0) {
+            dc1394_log_debug ("juju: no free frame on channel %d", channel);
+            return;
+        }
+        craw->mc_frame = craw->queue[craw->queue_head];
+        craw->queue_head = (craw->queue_head + 1) % craw->num_frames;
+        craw->queue_count--;
+
+        f = craw->frames + craw->mc_frame;
+        f->corrupt = 0;
+        f->packets_received = 0;
+        f->frame.packets_lost = 0;
+        f->frame.timestamp = 0;
+        if (tm->local_time) {
+            uint32_t bus_time = bus_time_to_usec (tm->cycle_timer);
+            uint32_t dma_time = bus_time_to_usec ((trailer & 0xffff) << 12);
+            f->frame.timestamp = tm->local_time -
+                (bus_time + 8000000 - dma_time) % 8000000;
+        }
+    }
+    if (craw->mc_frame < 0)
+        return;
+
+    f = craw->frames + craw->mc_frame;
+    if (length != f->frame.packet_size) {
+        f->frame.packets_lost++;
+        if (length > f->frame.packet_size)
+            length = f->frame.packet_size;
+    }
+    memcpy (f->frame.image + (uint64_t) f->packets_received *
+            f->frame.packet_size, payload, length);
+    if (++f->packets_received == f->frame.packets_per_frame)
+        deliver_frame (craw);
+}
+
+/* Walks the packets the kernel completed since the last event, then gives
+ * the chunks that were read entirely back to the kernel. */
+static int
+process_buffer (juju_mc_context * ctx, uint32_t completed)
+{
+    struct fw_cdev_get_cycle_timer tm;
+    struct fw_cdev_queue_iso queue;
+    struct fw_cdev_iso_packet chunk;
+    size_t size = ctx->buffer_size;
+
+    ctx->done_pos += (completed + size - ctx->done_pos % size) % size;
+
+    if (ioctl (ctx->fd, FW_CDEV_IOC_GET_CYCLE_TIMER, &tm) < 0)
+        tm.local_time = 0;
+
+    pthread_mutex_lock (&ctx->lock);
+    while (ctx->done_pos - ctx->read_pos >= 4) {
+        size_t offset = ctx->read_pos % size;
+        uint32_t header = le32toh (*(uint32_t *) (ctx->buffer + offset));
+        uint32_t total = 4 + (((header >> 16) + 3) & ~3) + 4;
+        unsigned char * packet = ctx->buffer + offset;
+        uint32_t trailer;
+
+        if (total > MC_MAX_PACKET) {
+            dc1394_log_error ("juju: Bad packet header 0x%08x in the "
+                    "multichannel buffer", header);
+            pthread_mutex_unlock (&ctx->lock);
+            return -1;
+        }
+        if (ctx->done_pos - ctx->read_pos < total)
+            break;
+        if (offset + total > size) {
+            memcpy (ctx->packet, packet, size - offset);
+            memcpy (ctx->packet + size - offset, ctx->buffer,
+                    offset + total - size);
+            packet = ctx->packet;
+        }
+        trailer = le32toh (*(uint32_t *) (packet + total - 4));
+        demux_packet (ctx, header, packet + 4, trailer, &tm);
+        ctx->read_pos += total;
+    }
+    pthread_mutex_unlock (&ctx->lock);
+
+    while (ctx->read_pos >= ctx->requeue_pos + MC_CHUNK_SIZE) {
+        chunk.control = FW_CDEV_ISO_PAYLOAD_LENGTH (MC_CHUNK_SIZE) |
+            FW_CDEV_ISO_INTERRUPT;
+        queue.packets = ptr_to_u64 (&chunk);
+        queue.data = ptr_to_u64 (ctx->buffer + ctx->requeue_pos % size);
+        queue.size = sizeof chunk;
+        queue.handle = ctx->handle;
+        if (ioctl (ctx->fd, FW_CDEV_IOC_QUEUE_ISO, &queue) < 0) {
+            dc1394_log_error ("juju: Failed to requeue a multichannel chunk: %m");
+            return -1;
+        }
+        ctx->requeue_pos += MC_CHUNK_SIZE;
+    }
+    return 0;
+}
+
+static void *
+receive_thread (void * arg)
+{
+    juju_mc_context * ctx = arg;
+    struct fw_cdev_event_iso_interrupt_mc mc;
+    struct pollfd fds[2];
+
+    fds[0].fd = ctx->fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = ctx->wake_pipe[0];
+    fds[1].events = POLLIN;
+
+    while (1) {
+        if (poll (fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            dc1394_log_error ("juju: Multichannel poll() failed: %m");
+            break;
+        }
+        if (fds[1].revents)
+            break;
+        if (read (ctx->fd, &mc, sizeof mc) < (int) sizeof mc)
+            continue;
+        if (mc.type != FW_CDEV_EVENT_ISO_INTERRUPT_MULTICHANNEL)
+            continue;
+        if (process_buffer (ctx, mc.completed) < 0)
+            break;
+    }
+    return NULL;
+}
+
+static void
+free_context (juju_mc_context * ctx)
+{
+    if (ctx->buffer && ctx->buffer != MAP_FAILED)
+        munmap (ctx->buffer, ctx->buffer_size);
+    if (ctx->fd >= 0)
+        close (ctx->fd);
+    if (ctx->wake_pipe[0] > 0) {
+        close (ctx->wake_pipe[0]);
+        close (ctx->wake_pipe[1]);
+    }
+    pthread_mutex_destroy (&ctx->lock);
+    free (ctx->packet);
+    free (ctx);
+}
+
+/* Opens the multichannel context of a card on the device of its first
+ * camera, and starts receiving with no channel selected. */
+static juju_mc_context *
+create_context (platform_camera_t * craw)
+{
+    struct fw_cdev_create_iso_context create;
+    struct fw_cdev_start_iso start_iso;
+    struct fw_cdev_iso_packet * chunks;
+    struct fw_cdev_queue_iso queue;
+    juju_mc_context * ctx;
+    int i;
+
+    ctx = calloc (1, sizeof *ctx);
+    if (ctx == NULL)
+        return NULL;
+    ctx->platform = craw->platform;
+    ctx->card = craw->card;
+    pthread_mutex_init (&ctx->lock, NULL);
+    ctx->packet = malloc (MC_MAX_PACKET);
+
+    ctx->fd = open (craw->filename, O_RDWR);
+    if (ctx->fd < 0 || ctx->packet == NULL) {
+        dc1394_log_error ("juju: Failed to open %s: %m", craw->filename);
+        free_context (ctx);
+        return NULL;
+    }
+
+    memset (&create, 0, sizeof create);
+    create.type = FW_CDEV_ISO_CONTEXT_RECEIVE_MULTICHANNEL;
+    if (ioctl (ctx->fd, FW_CDEV_IOC_CREATE_ISO_CONTEXT, &create) < 0) {
+        dc1394_log_error ("juju: Failed to create a multichannel context: %m");
+        free_context (ctx);
+        return NULL;
+    }
+    ctx->handle = create.handle;
+
+    ctx->buffer_size = MC_CHUNK_SIZE * MC_NUM_CHUNKS;
+    ctx->buffer = mmap (NULL, ctx->buffer_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED, ctx->fd, 0);
+    if (ctx->buffer == MAP_FAILED) {
+        dc1394_log_error ("juju: Failed to map the multichannel buffer: %m");
+        free_context (ctx);
+        return NULL;
+    }
+
+    chunks = calloc (MC_NUM_CHUNKS, sizeof *chunks);
+    if (chunks == NULL) {
+        free_context (ctx);
+        return NULL;
+    }
+    for (i = 0; i < MC_NUM_CHUNKS; i++)
+        chunks[i].control = FW_CDEV_ISO_PAYLOAD_LENGTH (MC_CHUNK_SIZE) |
+            FW_CDEV_ISO_INTERRUPT;
+    queue.packets = ptr_to_u64 (chunks);
+    queue.data = ptr_to_u64 (ctx->buffer);
+    queue.size = MC_NUM_CHUNKS * sizeof *chunks;
+    queue.handle = ctx->handle;
+    i = ioctl (ctx->fd, FW_CDEV_IOC_QUEUE_ISO, &queue);
+    free (chunks);
+    if (i < 0) {
+        dc1394_log_error ("juju: Failed to queue the multichannel buffer: %m");
+        free_context (ctx);
+        return NULL;
+    }
+    ctx->requeue_pos = 0;
+
+    start_iso.cycle = -1;
+    start_iso.tags = FW_CDEV_ISO_CONTEXT_MATCH_ALL_TAGS;
+    start_iso.sync = 0;
+    start_iso.handle = ctx->handle;
+    if (ioctl (ctx->fd, FW_CDEV_IOC_START_ISO, &start_iso) < 0) {
+        dc1394_log_error ("juju: Failed to start multichannel reception: %m");
+        free_context (ctx);
+        return NULL;
+    }
+
+    if (pipe (ctx->wake_pipe) < 0 ||
+            pthread_create (&ctx->thread, NULL, receive_thread, ctx) != 0) {
+        dc1394_log_error ("juju: Failed to start the receive thread");
+        free_context (ctx);
+        return NULL;
+    }
+
+    dc1394_log_debug ("juju: Multichannel context started on card %d",
+            ctx->card);
+    return ctx;
+}
+
+static void
+destroy_context (juju_mc_context * ctx)
+{
+    struct fw_cdev_stop_iso stop;
+    juju_mc_context ** ptr;
+
+    if (write (ctx->wake_pipe[1], "", 1) < 0)
+        dc1394_log_warning ("juju: Failed to wake the receive thread");
+    pthread_join (ctx->thread, NULL);
+
+    stop.handle = ctx->handle;
+    ioctl (ctx->fd, FW_CDEV_IOC_STOP_ISO, &stop);
+
+    for (ptr = &ctx->platform->mc_contexts; *ptr; ptr = &(*ptr)->next) {
+        if (*ptr == ctx) {
+            *ptr = ctx->next;
+            break;
+        }
+    }
+    free_context (ctx);
+}
+
+static dc1394error_t
+set_channels (juju_mc_context * ctx, uint64_t channels)
+{
+    struct fw_cdev_set_iso_channels set;
+
+    set.channels = channels;
+    set.handle = ctx->handle;
+    if (ioctl (ctx->fd, FW_CDEV_IOC_SET_ISO_CHANNELS, &set) < 0) {
+        dc1394_log_error ("juju: Failed to select iso channels 0x%"PRIx64
+                ": %m", channels);
+        return DC1394_IOCTL_FAILURE;
+    }
+    ctx->channels = channels;
+    return DC1394_SUCCESS;
+}
+
+static void
+free_frames (platform_camera_t * craw)
+{
+    free (craw->frames);
+    free (craw->queue);
+    free (craw->ready);
+    free (craw->spare);
+    free (craw->buffer);
+    craw->frames = NULL;
+    craw->queue = craw->ready = craw->spare = NULL;
+    craw->buffer = NULL;
+}
+
+dc1394error_t
+juju_mc_capture_setup (platform_camera_t * craw, uint32_t num_dma_buffers,
+        dc1394video_frame_t * proto)
+{
+    platform_t * p = craw->platform;
+    juju_mc_context * ctx;
+    dc1394error_t err;
+    int i;
+
+    craw->num_frames = num_dma_buffers;
+    craw->queue_head = craw->queue_count = 0;
+    craw->ready_head = craw->ready_count = 0;
+    craw->spare_count = 0;
+    craw->mc_frame = -1;
+    craw->buffer_size = proto->total_bytes * craw->num_frames;
+    craw->buffer = malloc (craw->buffer_size);
+    craw->frames = calloc (craw->num_frames, sizeof *craw->frames);
+    craw->queue = malloc (craw->num_frames * sizeof *craw->queue);
+    craw->ready = malloc (craw->num_frames * sizeof *craw->ready);
+    craw->spare = malloc (craw->num_frames * sizeof *craw->spare);
+    if (craw->buffer == NULL || craw->frames == NULL || craw->queue == NULL
+            || craw->ready == NULL || craw->spare == NULL) {
+        free_frames (craw);
+        return DC1394_MEMORY_ALLOCATION_FAILURE;
+    }
+
+    for (i = 0; i < craw->num_frames; i++) {
+        struct juju_frame * f = craw->frames + i;
+        memcpy (&f->frame, proto, sizeof f->frame);
+        f->frame.image = craw->buffer + i * proto->total_bytes;
+        f->frame.id = i;
+        f->queued_time = capture_get_time_usec ();
+        craw->queue[craw->queue_count++] = i;
+    }
+
+    if (open_notify_fd (craw) != DC1394_SUCCESS) {
+        free_frames (craw);
+        return DC1394_FAILURE;
+    }
+
+    pthread_mutex_lock (&p->mc_lock);
+    for (ctx = p->mc_contexts; ctx; ctx = ctx->next)
+        if (ctx->card == craw->card)
+            break;
+    if (ctx == NULL) {
+        ctx = create_context (craw);
+        if (ctx == NULL) {
+            pthread_mutex_unlock (&p->mc_lock);
+            close_notify_fd (craw);
+            free_frames (craw);
+            return DC1394_IOCTL_FAILURE;
+        }
+        ctx->next = p->mc_contexts;
+        p->mc_contexts = ctx;
+    }
+
+    err = DC1394_FAILURE;
+    pthread_mutex_lock (&ctx->lock);
+    if (ctx->cameras[craw->iso_channel])
+        dc1394_log_error ("juju: Iso channel %d is already received",
+                craw->iso_channel);
+    else
+        err = set_channels (ctx, ctx->channels |
+                ((uint64_t) 1 << craw->iso_channel));
+    if (err == DC1394_SUCCESS) {
+        ctx->cameras[craw->iso_channel] = craw;
+        ctx->num_cameras++;
+        craw->mc = ctx;
+    }
+    pthread_mutex_unlock (&ctx->lock);
+
+    if (err != DC1394_SUCCESS) {
+        if (ctx->num_cameras == 0)
+            destroy_context (ctx);
+        pthread_mutex_unlock (&p->mc_lock);
+        close_notify_fd (craw);
+        free_frames (craw);
+        return err;
+    }
+    pthread_mutex_unlock (&p->mc_lock);
+
+    dc1394_log_debug ("juju: Receiving channel %d with %d other camera(s)",
+            craw->iso_channel, ctx->num_cameras - 1);
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+juju_mc_capture_stop (platform_camera_t * craw)
+{
+    juju_mc_context * ctx = craw->mc;
+    platform_t * p = craw->platform;
+
+    pthread_mutex_lock (&p->mc_lock);
+    pthread_mutex_lock (&ctx->lock);
+    ctx->cameras[craw->iso_channel] = NULL;
+    ctx->num_cameras--;
+    set_channels (ctx, ctx->channels & ~((uint64_t) 1 << craw->iso_channel));
+    pthread_mutex_unlock (&ctx->lock);
+    if (ctx->num_cameras == 0)
+        destroy_context (ctx);
+    pthread_mutex_unlock (&p->mc_lock);
+
+    craw->mc = NULL;
+    close_notify_fd (craw);
+    free_frames (craw);
+    return DC1394_SUCCESS;
+}
+
+/* Takes the oldest complete frame, or with the latest policy the newest one
+ * after giving the older ones back. */
+static struct juju_frame *
+pop_ready (platform_camera_t * craw, dc1394capture_policy_t policy,
+        uint32_t * skipped)
+{
+    juju_mc_context * ctx = craw->mc;
+    struct juju_frame * f = NULL;
+
+    pthread_mutex_lock (&ctx->lock);
+    while (policy == DC1394_CAPTURE_POLICY_LATEST && craw->ready_count > 1) {
+        craw->queue[(craw->queue_head + craw->queue_count) %
+            craw->num_frames] = craw->ready[craw->ready_head];
+        craw->queue_count++;
+        craw->ready_head = (craw->ready_head + 1) % craw->num_frames;
+        craw->ready_count--;
+        (*skipped)++;
+    }
+    if (craw->ready_count > 0) {
+        f = craw->frames + craw->ready[craw->ready_head];
+        craw->ready_head = (craw->ready_head + 1) % craw->num_frames;
+        craw->ready_count--;
+        f->frame.frames_behind = craw->ready_count;
+    }
+    pthread_mutex_unlock (&ctx->lock);
+    return f;
+}
+
+dc1394error_t
+juju_mc_capture_dequeue (platform_camera_t * craw,
+        dc1394capture_policy_t policy, dc1394video_frame_t **frame_return)
+{
+    struct juju_frame * f;
+    uint32_t skipped = 0;
+
+    if ((policy < DC1394_CAPTURE_POLICY_MIN)
+            || (policy > DC1394_CAPTURE_POLICY_MAX))
+        return DC1394_INVALID_CAPTURE_POLICY;
+
+    *frame_return = NULL;
+
+    /* The notification descriptor is only reset once the ring is found
+     * empty, and checked again after that so no frame is left behind */
+    f = pop_ready (craw, policy, &skipped);
+    while (f == NULL) {
+        drain_notify_fd (craw, 0);
+        f = pop_ready (craw, policy, &skipped);
+        if (f || policy != DC1394_CAPTURE_POLICY_WAIT)
+            break;
+        drain_notify_fd (craw, -1);
+        f = pop_ready (craw, policy, &skipped);
+    }
+    if (f == NULL)
+        return DC1394_SUCCESS;
+
+    capture_account_frame (craw->camera, &f->frame, f->frame.timestamp,
+            f->queued_time);
+    if (policy == DC1394_CAPTURE_POLICY_LATEST)
+        capture_account_skipped (craw->camera, &f->frame, skipped);
+
+    *frame_return = &f->frame;
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+juju_mc_capture_enqueue (platform_camera_t * craw,
+        dc1394video_frame_t * frame)
+{
+    juju_mc_context * ctx = craw->mc;
+    struct juju_frame * f = craw->frames + frame->id;
+
+    f->queued_time = capture_get_time_usec ();
+    pthread_mutex_lock (&ctx->lock);
+    craw->queue[(craw->queue_head + craw->queue_count) % craw->num_frames] =
+        frame->id;
+    craw->queue_count++;
+    pthread_mutex_unlock (&ctx->lock);
+    return DC1394_SUCCESS;
+}
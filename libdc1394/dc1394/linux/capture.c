@@ -135,13 +135,19 @@ capture_linux_setup(platform_camera_t * craw, uint32_t num_dma_buffers)
     craw->capture.dma_last_buffer= -1;
     vwait.channel= craw->iso_channel;
 
+    craw->capture.queue_times= calloc(vmmap.nb_buffers, sizeof(uint64_t));
+
     /* QUEUE the buffers */
     for (i= 0; i < vmmap.nb_buffers; i++) {
         vwait.buffer= i;
+        if (craw->capture.queue_times)
+            craw->capture.queue_times[i]= capture_get_time_usec();
 
         if (ioctl(craw->capture.dma_fd,VIDEO1394_IOC_LISTEN_QUEUE_BUFFER,&vwait) < 0) {
             dc1394_log_error("VIDEO1394_IOC_LISTEN_QUEUE_BUFFER ioctl failed");
             ioctl(craw->capture.dma_fd, VIDEO1394_IOC_UNLISTEN_CHANNEL, &(vwait.channel));
+            free(craw->capture.queue_times);
+            craw->capture.queue_times=NULL;
             craw->capture_is_set=0;
             close (craw->capture.dma_fd);
             return DC1394_IOCTL_FAILURE;
@@ -156,6 +162,8 @@ capture_linux_setup(platform_camera_t * craw, uint32_t num_dma_buffers)
     if (craw->capture.dma_ring_buffer == (uint8_t*)(-1)) {
         dc1394_log_error("mmap failed!");
         ioctl(craw->capture.dma_fd, VIDEO1394_IOC_UNLISTEN_CHANNEL, &vmmap.channel);
+        free(craw->capture.queue_times);
+        craw->capture.queue_times=NULL;
         craw->capture_is_set=0;
         close (craw->capture.dma_fd);
 
@@ -331,6 +339,8 @@ dc1394_linux_capture_stop(platform_camera_t *craw)
 
         free (craw->capture.frames);
         craw->capture.frames = NULL;
+        free (craw->capture.queue_times);
+        craw->capture.queue_times = NULL;
 
         // this dma_device file is allocated by the strdup() function and can be freed here without problems.
         free(craw->capture.dma_device_file);
@@ -371,10 +381,9 @@ dc1394_linux_capture_stop(platform_camera_t *craw)
 }
 
 
-dc1394error_t
-dc1394_linux_capture_dequeue (platform_camera_t * craw,
-                        dc1394capture_policy_t policy,
-                        dc1394video_frame_t **frame)
+static dc1394error_t
+wait_next_buffer (platform_camera_t * craw, dc1394capture_policy_t policy,
+                  dc1394video_frame_t **frame)
 {
     dc1394capture_t * capture = &(craw->capture);
     struct video1394_wait vwait;
@@ -382,10 +391,6 @@ dc1394_linux_capture_dequeue (platform_camera_t * craw,
     int cb;
     int result=-1;
 
-    if ( (policy<DC1394_CAPTURE_POLICY_MIN) || (policy>DC1394_CAPTURE_POLICY_MAX) )
-        return DC1394_INVALID_CAPTURE_POLICY;
-
-    // default: return NULL in case of failures or lack of frames
     *frame=NULL;
 
     memset(&vwait, 0, sizeof(vwait));
@@ -425,11 +430,54 @@ dc1394_linux_capture_dequeue (platform_camera_t * craw,
     frame_tmp->frames_behind = vwait.buffer;
     frame_tmp->timestamp = (uint64_t) vwait.filltime.tv_sec * 1000000 + vwait.filltime.tv_usec;
 
+    capture_account_frame (craw->camera, frame_tmp, frame_tmp->timestamp,
+            capture->queue_times ? capture->queue_times[cb] : 0);
+
     *frame=frame_tmp;
 
     return DC1394_SUCCESS;
 }
 
+dc1394error_t
+dc1394_linux_capture_dequeue (platform_camera_t * craw,
+                        dc1394capture_policy_t policy,
+                        dc1394video_frame_t **frame)
+{
+    dc1394video_frame_t * newer;
+    dc1394error_t err;
+    uint32_t skipped = 0;
+
+    if ( (policy<DC1394_CAPTURE_POLICY_MIN) || (policy>DC1394_CAPTURE_POLICY_MAX) )
+        return DC1394_INVALID_CAPTURE_POLICY;
+
+    // default: return NULL in case of failures or lack of frames
+    *frame=NULL;
+
+    if (policy != DC1394_CAPTURE_POLICY_LATEST)
+        return wait_next_buffer (craw, policy, frame);
+
+    err = wait_next_buffer (craw, DC1394_CAPTURE_POLICY_WAIT, frame);
+    if (err != DC1394_SUCCESS || *frame == NULL)
+        return err;
+
+    // video1394 needs each buffer to be picked up before it can be queued
+    // again, so walk the buffers that are behind and queue the older ones
+    while ((*frame)->frames_behind > 0) {
+        if (wait_next_buffer (craw, DC1394_CAPTURE_POLICY_POLL, &newer)
+                != DC1394_SUCCESS || newer == NULL)
+            break;
+        err = dc1394_linux_capture_enqueue (craw, *frame);
+        *frame = newer;
+        if (err != DC1394_SUCCESS)
+            break;
+        skipped++;
+    }
+
+    capture_account_skipped (craw->camera, *frame, skipped);
+
+    return err;
+}
+
 dc1394error_t
 dc1394_linux_capture_enqueue (platform_camera_t * craw,
                         dc1394video_frame_t * frame)
@@ -447,6 +495,8 @@ dc1394_linux_capture_enqueue (platform_camera_t * craw,
     vwait.channel = craw->iso_channel;
     vwait.buffer = frame->id;
 
+    if (craw->capture.queue_times)
+        craw->capture.queue_times[frame->id] = capture_get_time_usec ();
     if (ioctl(craw->capture.dma_fd, VIDEO1394_IOC_LISTEN_QUEUE_BUFFER, &vwait) < 0)  {
         dc1394_log_error("VIDEO1394_IOC_LISTEN_QUEUE_BUFFER ioctl failed!");
         return DC1394_IOCTL_FAILURE;
@@ -87,17 +87,21 @@ static int
 read_retry (struct raw1394_handle * handle, nodeid_t node, nodeaddr_t addr,
             size_t length, quadlet_t * buffer)
 {
-    int retry = DC1394_MAX_RETRIES;
-    while (retry > 0) {
+    transaction_retry_t retry;
+    int wait;
+
+    transaction_retry_start (NULL, &retry, DC1394_MAX_RETRIES);
+    for (;;) {
         if (raw1394_read (handle, node, addr, length, buffer) == 0)
             return 0;
         if (errno != EAGAIN)
             return -1;
 
-        usleep (DC1394_SLOW_DOWN);
-        retry--;
+        wait = transaction_retry_next (&retry, TRANSACTION_RCODE_BUSY);
+        if (wait < 0)
+            return -1;
+        usleep (wait);
     }
-    return -1;
 }
 
 static platform_device_list_t *
@@ -252,10 +256,13 @@ static dc1394error_t
 dc1394_linux_camera_read (platform_camera_t * cam, uint64_t offset,
         uint32_t * quads, int num_quads)
 {
-    int i, retval, retry = DC1394_MAX_RETRIES;
+    int i, retval, wait;
+    transaction_retry_t retry;
+
+    transaction_retry_start (cam->camera, &retry, DC1394_MAX_RETRIES);
 
     /* retry a few times if necessary (addition by PDJ) */
-    while(retry--)  {
+    for (;;) {
 #ifdef DC1394_DEBUG_LOWEST_LEVEL
         fprintf(stderr,"get %d regs at 0x%llx : ",
                 num_quads, offset + CONFIG_ROM_BASE);
@@ -266,48 +273,71 @@ dc1394_linux_camera_read (platform_camera_t * cam, uint64_t offset,
 #endif
 
         if (!retval)
-            goto out;
-        else if (errno != EAGAIN)
-            return ( retval ? DC1394_RAW1394_FAILURE : DC1394_SUCCESS );
+            break;
+        if (errno != EAGAIN) {
+            transaction_account (cam->camera, &retry, TRANSACTION_RCODE_UNKNOWN,
+                    DC1394_RAW1394_FAILURE);
+            return DC1394_RAW1394_FAILURE;
+        }
 
         // usleep is executed only if the read fails!!!
-        usleep(DC1394_SLOW_DOWN);
+        wait = transaction_retry_next (&retry, TRANSACTION_RCODE_BUSY);
+        if (wait < 0) {
+            transaction_account (cam->camera, &retry, TRANSACTION_RCODE_BUSY,
+                    DC1394_RAW1394_FAILURE);
+            return DC1394_RAW1394_FAILURE;
+        }
+        usleep(wait);
     }
 
- out:
+    transaction_account (cam->camera, &retry, 0, DC1394_SUCCESS);
     /* conditionally byte swap the value */
     for (i = 0; i < num_quads; i++)
         quads[i] = ntohl (quads[i]);
-    return ( retval ? DC1394_RAW1394_FAILURE : DC1394_SUCCESS );
+    return DC1394_SUCCESS;
 }
 
 static dc1394error_t
 dc1394_linux_camera_write (platform_camera_t * cam, uint64_t offset,
         const uint32_t * quads, int num_quads)
 {
-    int i, retval, retry= DC1394_MAX_RETRIES;
+    int i, retval, wait;
     uint32_t value[num_quads];
+    transaction_retry_t retry;
 
     /* conditionally byte swap the value (addition by PDJ) */
     for (i = 0; i < num_quads; i++)
         value[i] = htonl (quads[i]);
 
+    transaction_retry_start (cam->camera, &retry, DC1394_MAX_RETRIES);
+
     /* retry a few times if necessary */
-    while(retry--) {
+    for (;;) {
 #ifdef DC1394_DEBUG_LOWEST_LEVEL
         fprintf(stderr,"set %d regs at 0x%llx to value 0x%lx [...]\n",
                 num_quads, offset + CONFIG_ROM_BASE, value[0]);
 #endif
         retval = raw1394_write(cam->handle, 0xffc0 | cam->node, offset + CONFIG_ROM_BASE, 4 * num_quads, value);
 
-        if (!retval || (errno != EAGAIN))
-            return ( retval ? DC1394_RAW1394_FAILURE : DC1394_SUCCESS );
+        if (!retval) {
+            transaction_account (cam->camera, &retry, 0, DC1394_SUCCESS);
+            return DC1394_SUCCESS;
+        }
+        if (errno != EAGAIN) {
+            transaction_account (cam->camera, &retry, TRANSACTION_RCODE_UNKNOWN,
+                    DC1394_RAW1394_FAILURE);
+            return DC1394_RAW1394_FAILURE;
+        }
 
-        // usleep is executed only if the read fails!!!
-        usleep(DC1394_SLOW_DOWN);
+        // usleep is executed only if the write fails!!!
+        wait = transaction_retry_next (&retry, TRANSACTION_RCODE_BUSY);
+        if (wait < 0) {
+            transaction_account (cam->camera, &retry, TRANSACTION_RCODE_BUSY,
+                    DC1394_RAW1394_FAILURE);
+            return DC1394_RAW1394_FAILURE;
+        }
+        usleep(wait);
     }
-
-    return DC1394_RAW1394_FAILURE;
 }
 
 static dc1394error_t
@@ -439,6 +469,13 @@ dc1394_linux_camera_get_node(platform_camera_t *cam, uint32_t *node,
     return DC1394_SUCCESS;
 }
 
+static dc1394error_t
+dc1394_linux_camera_get_bus(platform_camera_t *cam, uint32_t *bus)
+{
+    *bus = cam->port;
+    return DC1394_SUCCESS;
+}
+
 dc1394error_t
 dc1394_camera_get_linux_port(dc1394camera_t *camera, uint32_t *port)
 {
@@ -470,6 +507,7 @@ linux_dispatch = {
     .reset_bus = dc1394_linux_reset_bus,
     .camera_print_info = dc1394_linux_camera_print_info,
     .camera_get_node = dc1394_linux_camera_get_node,
+    .camera_get_bus = dc1394_linux_camera_get_bus,
     .set_broadcast = dc1394_linux_set_broadcast,
     .get_broadcast = dc1394_linux_get_broadcast,
     .read_cycle_timer = dc1394_linux_read_cycle_timer,
@@ -50,6 +50,7 @@ typedef struct __dc1394_capture
     uint32_t                 flags;
 
     dc1394video_frame_t     *frames;
+    uint64_t                *queue_times;
 } dc1394capture_t;
 
 struct _platform_camera_t {
@@ -101,9 +101,10 @@ typedef enum {
     DC1394_INVALID_STEREO_METHOD       = -36,
     DC1394_BASLER_NO_MORE_SFF_CHUNKS   = -37,
     DC1394_BASLER_CORRUPTED_SFF_CHUNK  = -38,
-    DC1394_BASLER_UNKNOWN_SFF_CHUNK    = -39
+    DC1394_BASLER_UNKNOWN_SFF_CHUNK    = -39,
+    DC1394_CAPTURE_NO_SPARE_BUFFER     = -40
 } dc1394error_t;
-#define DC1394_ERROR_MIN  DC1394_BASLER_UNKNOWN_SFF_CHUNK
+#define DC1394_ERROR_MIN  DC1394_CAPTURE_NO_SPARE_BUFFER
 #define DC1394_ERROR_MAX  DC1394_SUCCESS
 #define DC1394_ERROR_NUM (DC1394_ERROR_MAX-DC1394_ERROR_MIN+1)
 
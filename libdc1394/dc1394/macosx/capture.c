@@ -614,7 +614,7 @@ dc1394_macosx_capture_dequeue (platform_camera_t * craw,
     dc1394video_frame_t * frame_tmp = capture->frames + next;
     char ch;
 
-    if ( (policy<DC1394_CAPTURE_POLICY_MIN) || (policy>DC1394_CAPTURE_POLICY_MAX) )
+    if ( (policy<DC1394_CAPTURE_POLICY_MIN) || (policy>DC1394_CAPTURE_POLICY_POLL) )
         return DC1394_INVALID_CAPTURE_POLICY;
 
     // default: return NULL in case of failures or lack of frames
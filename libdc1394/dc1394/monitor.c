@@ -0,0 +1,541 @@
+/*
+ * 1394-Based Digital Camera Control Library
+ *
+ * Monitoring of feature values
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include "control.h"
+#include "register.h"
+#include "monitor.h"
+#include "offsets.h"
+#include "internal.h"
+
+#ifdef HAVE_PTHREAD_H
+
+#define MONITOR_MAX_FEATURES 32
+
+typedef struct {
+    dc1394feature_t id;
+    int index;                  /* position in the feature register blocks */
+    uint32_t inquiry;
+    uint64_t absoffset;         /* 0 when the feature has no absolute control */
+    float abs_min;
+    float abs_max;
+} monitor_feature_t;
+
+typedef struct _monitor_subscription_t {
+    uint32_t id;
+    uint64_t period;
+    uint64_t next_due;
+    int due;
+    int removed;                /* removed from a callback, freed after the dispatch */
+
+    uint32_t num_features;
+    monitor_feature_t features[MONITOR_MAX_FEATURES];
+    uint32_t values[MONITOR_MAX_FEATURES];
+    uint32_t abs_values[MONITOR_MAX_FEATURES];
+    uint32_t reported;          /* bit i set once feature i was reported */
+
+    dc1394feature_monitor_callback_t callback;
+    void * user;
+
+    struct _monitor_subscription_t * next;
+} monitor_subscription_t;
+
+typedef struct _feature_monitor_t {
+    dc1394camera_t * camera;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;        /* a subscription was added, or stop was set */
+    pthread_cond_t idle;        /* the callbacks of a poll returned */
+
+    monitor_subscription_t * subscriptions;
+    uint32_t last_id;
+    int dispatching;
+    int stop;
+    int detached;               /* stopped from a callback, the thread frees it */
+    int no_block_reads;         /* only touched by the thread */
+} feature_monitor_t;
+
+/* Serializes the creation of the monitor of a camera */
+static pthread_mutex_t monitor_create_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Time the polls are scheduled on [usec]: the monotonic clock where the
+ * condition variable can wait on it, so that a step of the wall clock does
+ * not hold the polls back */
+static uint64_t
+monitor_time_usec (void)
+{
+#ifdef HAVE_PTHREAD_CONDATTR_SETCLOCK
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    return capture_get_time_usec ();
+#endif
+}
+
+static void
+monitor_destroy (feature_monitor_t * m)
+{
+    monitor_subscription_t * s;
+
+    while ((s = m->subscriptions)) {
+        m->subscriptions = s->next;
+        free (s);
+    }
+    pthread_cond_destroy (&m->idle);
+    pthread_cond_destroy (&m->wake);
+    pthread_mutex_destroy (&m->mutex);
+    free (m);
+}
+
+/*
+ * Reads the value registers of the features wanted by the due subscriptions:
+ * the span from first to last with one block read, or a vectored read when
+ * the camera refuses block reads, then the absolute values of the features in
+ * absolute mode with one vectored read.  Called without the lock.
+ */
+static dc1394error_t
+monitor_read (feature_monitor_t * m, int first, int last, const int * wanted,
+        const uint64_t * absoffset, uint32_t * values, uint32_t * abs)
+{
+    dc1394camera_t * camera = m->camera;
+    dc1394register_io_t ios[FEATURE_BLOCK_QUADS];
+    dc1394error_t err = DC1394_FAILURE;
+    uint32_t num = 0;
+    int i;
+
+    if (!m->no_block_reads) {
+        err = dc1394_get_control_registers (camera,
+                REG_CAMERA_FEATURE_HI_BASE + first * 4U, values + first,
+                last - first + 1);
+        if (err != DC1394_SUCCESS) {
+            dc1394_log_debug ("Feature monitor: block reads failed, using vectored reads");
+            m->no_block_reads = 1;
+        }
+    }
+    if (err != DC1394_SUCCESS) {
+        for (i = first; i <= last; i++) {
+            if (!wanted[i])
+                continue;
+            ios[num].offset = camera->command_registers_base +
+                REG_CAMERA_FEATURE_HI_BASE + i * 4U;
+            ios[num].num_regs = 1;
+            ios[num].value = &values[i];
+            num++;
+        }
+        err = dc1394_get_registers_vector (camera, ios, num);
+        DC1394_ERR_RTN (err, "Could not read the feature registers");
+    }
+
+    num = 0;
+    for (i = first; i <= last; i++) {
+        if (!wanted[i] || !absoffset[i] || !(values[i] & 0x40000000UL))
+            continue;
+        ios[num].offset = absoffset[i] + REG_CAMERA_ABS_VALUE;
+        ios[num].num_regs = 1;
+        ios[num].value = &abs[i];
+        num++;
+    }
+    if (num > 0) {
+        err = dc1394_get_registers_vector (camera, ios, num);
+        DC1394_ERR_RTN (err, "Could not read the absolute feature values");
+    }
+    return DC1394_SUCCESS;
+}
+
+/* Calls back with the features of a due subscription that changed since the
+ * last poll.  Called with the lock held, which is released for the callbacks. */
+static void
+monitor_dispatch (feature_monitor_t * m, monitor_subscription_t * s,
+        const uint32_t * values, const uint32_t * abs)
+{
+    dc1394feature_info_t changed[MONITOR_MAX_FEATURES];
+    uint32_t num = 0, i;
+
+    for (i = 0; i < s->num_features; i++) {
+        const monitor_feature_t * f = &s->features[i];
+        uint32_t value = values[f->index];
+        int use_abs = f->absoffset && (value & 0x40000000UL);
+        dc1394feature_info_t * info;
+
+        if ((s->reported & (1U << i)) && value == s->values[i] &&
+                (!use_abs || abs[f->index] == s->abs_values[i]))
+            continue;
+
+        s->reported |= 1U << i;
+        s->values[i] = value;
+        if (use_abs)
+            s->abs_values[i] = abs[f->index];
+
+        info = &changed[num++];
+        memset (info, 0, sizeof (*info));
+        info->id = f->id;
+        info->available = DC1394_TRUE;
+        feature_decode_registers (info, f->inquiry, value);
+        info->abs_min = f->abs_min;
+        info->abs_max = f->abs_max;
+        if (use_abs)
+            memcpy (&info->abs_value, &s->abs_values[i], 4);
+    }
+
+    if (num == 0)
+        return;
+
+    // the camera may be freed from a callback, which stops the monitor
+    for (i = 0; i < num && !m->stop; i++) {
+        pthread_mutex_unlock (&m->mutex);
+        s->callback (m->camera, &changed[i], s->user);
+        pthread_mutex_lock (&m->mutex);
+    }
+}
+
+static void *
+monitor_thread (void * arg)
+{
+    feature_monitor_t * m = arg;
+    uint32_t values[FEATURE_BLOCK_QUADS], abs[FEATURE_BLOCK_QUADS];
+    uint64_t absoffset[FEATURE_BLOCK_QUADS];
+    int wanted[FEATURE_BLOCK_QUADS];
+    monitor_subscription_t * s, ** prev;
+    int detached;
+
+    pthread_mutex_lock (&m->mutex);
+    while (!m->stop) {
+        uint64_t now = monitor_time_usec ();
+        uint64_t earliest = 0;
+        int first = FEATURE_BLOCK_QUADS, last = -1, have_earliest = 0;
+        dc1394error_t err;
+        uint32_t i;
+
+        for (s = m->subscriptions; s; s = s->next) {
+            if (!have_earliest || s->next_due < earliest)
+                earliest = s->next_due;
+            have_earliest = 1;
+        }
+        if (!have_earliest) {
+            pthread_cond_wait (&m->wake, &m->mutex);
+            continue;
+        }
+        if (earliest > now) {
+            struct timespec ts;
+            ts.tv_sec = earliest / 1000000;
+            ts.tv_nsec = (earliest % 1000000) * 1000;
+            pthread_cond_timedwait (&m->wake, &m->mutex, &ts);
+            continue;
+        }
+
+        // poll together the subscriptions due within half a period
+        memset (wanted, 0, sizeof (wanted));
+        memset (absoffset, 0, sizeof (absoffset));
+        for (s = m->subscriptions; s; s = s->next) {
+            s->due = s->next_due <= now + s->period / 2;
+            if (!s->due)
+                continue;
+            for (i = 0; i < s->num_features; i++) {
+                const monitor_feature_t * f = &s->features[i];
+                wanted[f->index] = 1;
+                absoffset[f->index] = f->absoffset;
+                if (f->index < first)
+                    first = f->index;
+                if (f->index > last)
+                    last = f->index;
+            }
+        }
+
+        m->dispatching = 1;
+        pthread_mutex_unlock (&m->mutex);
+        err = monitor_read (m, first, last, wanted, absoffset, values, abs);
+        pthread_mutex_lock (&m->mutex);
+
+        // subscriptions added meanwhile are not due, and none was freed
+        for (s = m->subscriptions; s && !m->stop; s = s->next) {
+            if (!s->due)
+                continue;
+            if (s->next_due <= now)
+                s->next_due += ((now - s->next_due) / s->period + 1) * s->period;
+            else
+                s->next_due += s->period;
+            if (err == DC1394_SUCCESS && !s->removed)
+                monitor_dispatch (m, s, values, abs);
+        }
+
+        prev = &m->subscriptions;
+        while ((s = *prev)) {
+            if (s->removed) {
+                *prev = s->next;
+                free (s);
+            }
+            else
+                prev = &s->next;
+        }
+        m->dispatching = 0;
+        pthread_cond_broadcast (&m->idle);
+    }
+    detached = m->detached;
+    pthread_mutex_unlock (&m->mutex);
+    if (detached)
+        monitor_destroy (m);
+    return NULL;
+}
+
+static feature_monitor_t *
+monitor_get (dc1394camera_t * camera)
+{
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+    feature_monitor_t * m;
+    int ret;
+
+    pthread_mutex_lock (&monitor_create_mutex);
+    m = cpriv->monitor;
+    if (m) {
+        pthread_mutex_unlock (&monitor_create_mutex);
+        return m;
+    }
+
+    m = calloc (1, sizeof (feature_monitor_t));
+    if (!m) {
+        pthread_mutex_unlock (&monitor_create_mutex);
+        return NULL;
+    }
+    m->camera = camera;
+    pthread_mutex_init (&m->mutex, NULL);
+#ifdef HAVE_PTHREAD_CONDATTR_SETCLOCK
+    {
+        pthread_condattr_t attr;
+        pthread_condattr_init (&attr);
+        pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+        pthread_cond_init (&m->wake, &attr);
+        pthread_condattr_destroy (&attr);
+    }
+#else
+    pthread_cond_init (&m->wake, NULL);
+#endif
+    pthread_cond_init (&m->idle, NULL);
+
+    ret = pthread_create (&m->thread, NULL, monitor_thread, m);
+    if (ret != 0) {
+        dc1394_log_error ("Feature monitor: could not start thread: %s",
+                strerror (ret));
+        monitor_destroy (m);
+        m = NULL;
+    }
+    cpriv->monitor = m;
+    pthread_mutex_unlock (&monitor_create_mutex);
+    return m;
+}
+
+/* Reads what does not change while a subscription lives: the inquiry
+ * register, which comes from the register cache, and the absolute bounds */
+static dc1394error_t
+monitor_feature_setup (dc1394camera_t * camera, monitor_feature_t * f,
+        dc1394feature_t id)
+{
+    dc1394bool_t present;
+    uint32_t bounds[2];
+    dc1394error_t err;
+
+    if (id < DC1394_FEATURE_MIN || id > DC1394_FEATURE_MAX)
+        return DC1394_INVALID_FEATURE;
+
+    err = dc1394_feature_is_present (camera, id, &present);
+    DC1394_ERR_RTN (err, "Could not check feature presence");
+    if (present == DC1394_FALSE) {
+        dc1394_log_error ("Feature monitor: feature %d is not present", id);
+        return DC1394_INVALID_FEATURE;
+    }
+
+    f->id = id;
+    f->index = feature_register_index (id);
+    err = dc1394_get_control_register (camera,
+            REG_CAMERA_FEATURE_HI_BASE_INQ + f->index * 4U, &f->inquiry);
+    DC1394_ERR_RTN (err, "Could not check feature characteristics");
+
+    if (f->inquiry & 0x40000000UL) {
+        err = QueryAbsoluteCSROffset (camera, id, &f->absoffset);
+        DC1394_ERR_RTN (err, "Could not get the absolute CSR offset");
+        // cameras that refuse block reads get the bounds one at a time
+        if (dc1394_get_registers (camera, f->absoffset + REG_CAMERA_ABS_MIN,
+                    bounds, 2) != DC1394_SUCCESS) {
+            err = dc1394_get_absolute_register (camera, id, REG_CAMERA_ABS_MIN,
+                    &bounds[0]);
+            DC1394_ERR_RTN (err, "Could not get the absolute minimum");
+            err = dc1394_get_absolute_register (camera, id, REG_CAMERA_ABS_MAX,
+                    &bounds[1]);
+            DC1394_ERR_RTN (err, "Could not get the absolute maximum");
+        }
+        memcpy (&f->abs_min, &bounds[0], 4);
+        memcpy (&f->abs_max, &bounds[1], 4);
+    }
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_feature_monitor_add (dc1394camera_t * camera,
+        const dc1394feature_t * features, uint32_t num_features,
+        uint32_t period, dc1394feature_monitor_callback_t callback,
+        void * user, uint32_t * id)
+{
+    monitor_subscription_t * s;
+    feature_monitor_t * m;
+    dc1394error_t err;
+    uint32_t i;
+
+    if (camera == NULL)
+        return DC1394_CAMERA_NOT_INITIALIZED;
+    if (!features || num_features == 0 ||
+            num_features > MONITOR_MAX_FEATURES || period == 0 ||
+            !callback || !id)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+
+    s = calloc (1, sizeof (monitor_subscription_t));
+    if (!s)
+        return DC1394_MEMORY_ALLOCATION_FAILURE;
+    for (i = 0; i < num_features; i++) {
+        err = monitor_feature_setup (camera, &s->features[i], features[i]);
+        if (err != DC1394_SUCCESS) {
+            free (s);
+            return err;
+        }
+    }
+    s->num_features = num_features;
+    s->period = period;
+    s->callback = callback;
+    s->user = user;
+
+    m = monitor_get (camera);
+    if (!m) {
+        free (s);
+        return DC1394_FAILURE;
+    }
+
+    pthread_mutex_lock (&m->mutex);
+    s->id = ++m->last_id;
+    s->next_due = monitor_time_usec ();
+    s->next = m->subscriptions;
+    m->subscriptions = s;
+    *id = s->id;
+    pthread_cond_signal (&m->wake);
+    pthread_mutex_unlock (&m->mutex);
+
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_feature_monitor_remove (dc1394camera_t * camera, uint32_t id)
+{
+    feature_monitor_t * m;
+    monitor_subscription_t * s, ** prev;
+
+    if (camera == NULL)
+        return DC1394_CAMERA_NOT_INITIALIZED;
+
+    pthread_mutex_lock (&monitor_create_mutex);
+    m = DC1394_CAMERA_PRIV (camera)->monitor;
+    pthread_mutex_unlock (&monitor_create_mutex);
+    if (!m)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+
+    pthread_mutex_lock (&m->mutex);
+    if (pthread_equal (pthread_self (), m->thread)) {
+        // from a callback: the dispatch frees it when it is done
+        for (s = m->subscriptions; s; s = s->next)
+            if (s->id == id && !s->removed)
+                break;
+        if (s)
+            s->removed = 1;
+        pthread_mutex_unlock (&m->mutex);
+        return s ? DC1394_SUCCESS : DC1394_INVALID_ARGUMENT_VALUE;
+    }
+
+    while (m->dispatching)
+        pthread_cond_wait (&m->idle, &m->mutex);
+    for (prev = &m->subscriptions; (s = *prev); prev = &s->next)
+        if (s->id == id)
+            break;
+    if (s)
+        *prev = s->next;
+    pthread_mutex_unlock (&m->mutex);
+
+    if (!s)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+    free (s);
+    return DC1394_SUCCESS;
+}
+
+void
+feature_monitor_free (dc1394camera_t * camera)
+{
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+    feature_monitor_t * m = cpriv->monitor;
+
+    if (!m)
+        return;
+    cpriv->monitor = NULL;
+
+    pthread_mutex_lock (&m->mutex);
+    m->stop = 1;
+    pthread_cond_signal (&m->wake);
+    if (pthread_equal (pthread_self (), m->thread)) {
+        // from a callback: the thread cannot join itself, it frees the
+        // monitor once the callback returns
+        m->detached = 1;
+        pthread_detach (m->thread);
+        pthread_mutex_unlock (&m->mutex);
+        return;
+    }
+    pthread_mutex_unlock (&m->mutex);
+    pthread_join (m->thread, NULL);
+    monitor_destroy (m);
+}
+
+#else
+
+dc1394error_t
+dc1394_feature_monitor_add (dc1394camera_t * camera,
+        const dc1394feature_t * features, uint32_t num_features,
+        uint32_t period, dc1394feature_monitor_callback_t callback,
+        void * user, uint32_t * id)
+{
+    dc1394_log_error ("Feature monitors need POSIX threads");
+    return DC1394_FUNCTION_NOT_SUPPORTED;
+}
+
+dc1394error_t
+dc1394_feature_monitor_remove (dc1394camera_t * camera, uint32_t id)
+{
+    return DC1394_FUNCTION_NOT_SUPPORTED;
+}
+
+void
+feature_monitor_free (dc1394camera_t * camera)
+{
+}
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ * 1394-Based Digital Camera Control Library
+ *
+ * Monitoring of feature values
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <dc1394/log.h>
+#include <dc1394/control.h>
+
+#ifndef __DC1394_MONITOR_H__
+#define __DC1394_MONITOR_H__
+
+/*! \file dc1394/monitor.h
+    \brief Monitoring of feature values
+
+    A monitor polls a set of features at a given period and calls back with the features whose value or mode changed.
+    All the subscriptions of a camera share one background thread: the subscriptions that fall due within half a period
+    of each other are polled together, with one block read of the span of feature registers they cover and one vectored
+    read of the absolute values in use. The first poll of a subscription reports all its features.
+
+    The monitor needs POSIX threads, and a backend that accepts register reads from several threads (Juju, USB). The
+    Linux raw1394 backend does not: do not use the camera from other threads while a monitor runs on it.
+*/
+
+/**
+ * Called with a feature whose value, mode or absolute value changed. The feature is filled as by
+ * dc1394_feature_get(), the absolute bounds being those read when the subscription was added. The callback runs in the
+ * monitor thread and delays the polls of the camera while it runs. It may remove subscriptions, its own included, and
+ * free the camera: no callback is called after that, and the monitor thread ends once the callback returns.
+ */
+typedef void (*dc1394feature_monitor_callback_t)(dc1394camera_t *camera, const dc1394feature_info_t *feature,
+        void *user);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Subscribes to the changes of up to 32 features, polled every period microseconds. The features must be present.
+ * The identifier returned in id is used to remove the subscription.
+ */
+dc1394error_t dc1394_feature_monitor_add(dc1394camera_t *camera, const dc1394feature_t *features, uint32_t num_features,
+        uint32_t period, dc1394feature_monitor_callback_t callback, void *user, uint32_t *id);
+
+/**
+ * Removes a subscription. Once this returns the callback of the subscription is not running and will not be called
+ * again, unless this is called from the callback itself.
+ */
+dc1394error_t dc1394_feature_monitor_remove(dc1394camera_t *camera, uint32_t id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,538 @@
+/*
+ * 1394-Based Digital Camera Control Library
+ *
+ * Capture pipeline
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include "control.h"
+#include "capture.h"
+#include "pipeline.h"
+#include "internal.h"
+
+#ifdef HAVE_PTHREAD_H
+
+#define PIPELINE_MAX_STAGES 16
+
+enum {
+    STAGE_CAPTURE,
+    STAGE_DEBAYER,
+    STAGE_CONVERT,
+    STAGE_CALLBACK
+};
+
+/* A frame in flight, with the buffers of the conversion stages it goes
+ * through.  Only the stage that popped it from its ring touches it. */
+typedef struct {
+    dc1394video_frame_t * captured;     /* frame of the ring buffer, until copied */
+    dc1394video_frame_t * current;      /* frame the next stage works on */
+    dc1394video_frame_t work[2];        /* outputs of the conversion stages */
+    uint64_t dequeue_time;
+    uint64_t push_time;
+    int failed;
+} pipeline_item_t;
+
+/* Bounded single-producer single-consumer ring of item numbers.  The
+ * pipeline never has more items than the ring can hold, so pushing never
+ * fails.  The consumer only sleeps on the condition variable when the ring
+ * is empty, and the producer only takes the mutex when it is asleep. */
+typedef struct {
+    uint32_t * slots;
+    uint32_t mask;
+    uint32_t head;              /* written by the consumer */
+    uint32_t tail;              /* written by the producer */
+    int sleeping;
+    int closed;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} pipeline_ring_t;
+
+typedef struct {
+    int type;
+    dc1394bayer_method_t method;
+    dc1394color_filter_t color_filter;
+    dc1394color_coding_t color_coding;
+    dc1394pipeline_callback_t callback;
+    void * user;
+
+    pipeline_ring_t in;         /* items for the stage; free items for stage 0 */
+    pthread_t thread;
+    int thread_started;
+    dc1394pipeline_stats_t stats;
+    dc1394pipeline_t * pipeline;
+} pipeline_stage_t;
+
+struct __dc1394pipeline_t {
+    dc1394camera_t * camera;
+    uint32_t num_items;
+    pipeline_item_t * items;
+    uint32_t num_stages;
+    pipeline_stage_t stages[PIPELINE_MAX_STAGES];
+    int running;
+};
+
+static dc1394error_t
+ring_init (pipeline_ring_t * r, uint32_t num_items)
+{
+    uint32_t size = 1;
+
+    while (size < num_items)
+        size <<= 1;
+    r->slots = malloc (size * sizeof *r->slots);
+    if (!r->slots)
+        return DC1394_MEMORY_ALLOCATION_FAILURE;
+    r->mask = size - 1;
+    r->head = r->tail = 0;
+    r->sleeping = r->closed = 0;
+    pthread_mutex_init (&r->lock, NULL);
+    pthread_cond_init (&r->cond, NULL);
+    return DC1394_SUCCESS;
+}
+
+static void
+ring_free (pipeline_ring_t * r)
+{
+    if (!r->slots)
+        return;
+    pthread_mutex_destroy (&r->lock);
+    pthread_cond_destroy (&r->cond);
+    free (r->slots);
+    r->slots = NULL;
+}
+
+static void
+ring_wake (pipeline_ring_t * r)
+{
+    pthread_mutex_lock (&r->lock);
+    pthread_cond_signal (&r->cond);
+    pthread_mutex_unlock (&r->lock);
+}
+
+static void
+ring_push (pipeline_ring_t * r, uint32_t item)
+{
+    uint32_t tail = r->tail;
+
+    r->slots[tail & r->mask] = item;
+    __atomic_store_n (&r->tail, tail + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n (&r->sleeping, __ATOMIC_SEQ_CST))
+        ring_wake (r);
+}
+
+/* Pops the oldest item, waiting for one.  Returns -1 once the ring is
+ * closed and empty. */
+static int
+ring_pop (pipeline_ring_t * r)
+{
+    uint32_t head = r->head;
+    int item;
+
+    if (__atomic_load_n (&r->tail, __ATOMIC_ACQUIRE) == head) {
+        pthread_mutex_lock (&r->lock);
+        __atomic_store_n (&r->sleeping, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n (&r->tail, __ATOMIC_SEQ_CST) == head &&
+                !r->closed)
+            pthread_cond_wait (&r->cond, &r->lock);
+        __atomic_store_n (&r->sleeping, 0, __ATOMIC_RELAXED);
+        pthread_mutex_unlock (&r->lock);
+        if (__atomic_load_n (&r->tail, __ATOMIC_ACQUIRE) == head)
+            return -1;
+    }
+
+    item = r->slots[head & r->mask];
+    __atomic_store_n (&r->head, head + 1, __ATOMIC_RELEASE);
+    return item;
+}
+
+static void
+ring_close (pipeline_ring_t * r)
+{
+    pthread_mutex_lock (&r->lock);
+    r->closed = 1;
+    pthread_cond_signal (&r->cond);
+    pthread_mutex_unlock (&r->lock);
+}
+
+/* Gives the captured frame of an item back to the ring buffer.  The call
+ * is serialized with the capture thread by dc1394_capture_enqueue(). */
+static void
+release_captured (dc1394pipeline_t * p, pipeline_item_t * item)
+{
+    if (!item->captured)
+        return;
+    dc1394_capture_enqueue (p->camera, item->captured);
+    item->captured = NULL;
+}
+
+static void
+account_stage (pipeline_stage_t * s, pipeline_item_t * item, uint64_t start,
+        uint64_t end)
+{
+    uint64_t latency = end - item->dequeue_time;
+
+    s->stats.frames++;
+    s->stats.wait_time += start - item->push_time;
+    s->stats.busy_time += end - start;
+    if (end - start > s->stats.max_busy_time)
+        s->stats.max_busy_time = end - start;
+    s->stats.latency += latency;
+    if (latency > s->stats.max_latency)
+        s->stats.max_latency = latency;
+}
+
+/* Converts the current frame of an item into one of its work frames. */
+static dc1394error_t
+convert_item (pipeline_stage_t * s, pipeline_item_t * item)
+{
+    dc1394video_frame_t * in = item->current;
+    dc1394video_frame_t * out = (in == &item->work[0]) ?
+        &item->work[1] : &item->work[0];
+    dc1394error_t err;
+
+    if (s->type == STAGE_DEBAYER) {
+        if (s->color_filter)
+            in->color_filter = s->color_filter;
+        err = dc1394_debayer_frames (in, out, s->method);
+    } else {
+        out->color_coding = s->color_coding;
+        out->yuv_byte_order = in->yuv_byte_order;
+        err = dc1394_convert_frames (in, out);
+    }
+    if (err != DC1394_SUCCESS)
+        return err;
+
+    out->timestamp = in->timestamp;
+    out->sequence = in->sequence;
+    out->frames_behind = in->frames_behind;
+    out->frames_skipped = in->frames_skipped;
+    out->packets_lost = in->packets_lost;
+    out->camera = in->camera;
+    out->id = in->id;
+    out->rows_available = out->size[1];
+
+    if (in == item->captured)
+        release_captured (s->pipeline, item);
+    item->current = out;
+    return DC1394_SUCCESS;
+}
+
+static void *
+stage_thread (void * arg)
+{
+    pipeline_stage_t * s = arg;
+    dc1394pipeline_t * p = s->pipeline;
+    int last = (s == p->stages + p->num_stages - 1);
+    pipeline_ring_t * next = last ? &p->stages[0].in : &(s + 1)->in;
+    int index;
+
+    while ((index = ring_pop (&s->in)) >= 0) {
+        pipeline_item_t * item = p->items + index;
+        uint64_t start = capture_get_time_usec ();
+
+        if (!item->failed) {
+            if (s->type == STAGE_CALLBACK)
+                s->callback (item->current, s->user);
+            else if (convert_item (s, item) != DC1394_SUCCESS) {
+                s->stats.frames_failed++;
+                item->failed = 1;
+            }
+        }
+
+        account_stage (s, item, start, capture_get_time_usec ());
+        if (last)
+            release_captured (p, item);
+        item->push_time = capture_get_time_usec ();
+        ring_push (next, index);
+    }
+    return NULL;
+}
+
+/* Runs on the capture thread: attaches the new frame to a free item, waiting
+ * for one to come back from the last stage if needed. */
+static dc1394bool_t
+capture_callback (dc1394camera_t * camera, dc1394video_frame_t * frame,
+        void * user)
+{
+    dc1394pipeline_t * p = user;
+    pipeline_stage_t * s = p->stages;
+    uint64_t start = capture_get_time_usec ();
+    pipeline_item_t * item;
+    int index;
+
+    index = ring_pop (&s->in);
+    if (index < 0)
+        return DC1394_TRUE;
+
+    item = p->items + index;
+    item->captured = frame;
+    item->current = frame;
+    item->failed = 0;
+    item->dequeue_time = start;
+    item->push_time = start;
+    account_stage (s, item, start, capture_get_time_usec ());
+
+    item->push_time = capture_get_time_usec ();
+    ring_push (&p->stages[1].in, index);
+    return DC1394_FALSE;
+}
+
+static pipeline_stage_t *
+add_stage (dc1394pipeline_t * p, int type)
+{
+    pipeline_stage_t * s;
+
+    if (p->running || p->num_stages == PIPELINE_MAX_STAGES)
+        return NULL;
+    s = p->stages + p->num_stages;
+    memset (s, 0, sizeof *s);
+    s->type = type;
+    s->pipeline = p;
+    if (ring_init (&s->in, p->num_items) != DC1394_SUCCESS)
+        return NULL;
+    p->num_stages++;
+    return s;
+}
+
+dc1394pipeline_t *
+dc1394_pipeline_new (dc1394camera_t * camera, uint32_t max_frames)
+{
+    dc1394pipeline_t * p;
+    uint32_t i;
+
+    if (!camera || max_frames == 0)
+        return NULL;
+
+    p = calloc (1, sizeof *p);
+    if (!p)
+        return NULL;
+    p->camera = camera;
+    p->num_items = max_frames;
+    p->items = calloc (max_frames, sizeof *p->items);
+    if (!p->items || !add_stage (p, STAGE_CAPTURE)) {
+        dc1394_pipeline_free (p);
+        return NULL;
+    }
+    for (i = 0; i < max_frames; i++)
+        ring_push (&p->stages[0].in, i);
+    return p;
+}
+
+dc1394error_t
+dc1394_pipeline_add_debayer (dc1394pipeline_t * p, dc1394bayer_method_t method,
+        dc1394color_filter_t color_filter)
+{
+    pipeline_stage_t * s;
+
+    if ((method < DC1394_BAYER_METHOD_MIN) || (method > DC1394_BAYER_METHOD_MAX))
+        return DC1394_INVALID_BAYER_METHOD;
+    s = add_stage (p, STAGE_DEBAYER);
+    if (!s)
+        return DC1394_FAILURE;
+    s->method = method;
+    s->color_filter = color_filter;
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_pipeline_add_convert (dc1394pipeline_t * p,
+        dc1394color_coding_t color_coding)
+{
+    pipeline_stage_t * s;
+
+    if ((color_coding < DC1394_COLOR_CODING_MIN) ||
+            (color_coding > DC1394_COLOR_CODING_MAX))
+        return DC1394_INVALID_COLOR_CODING;
+    s = add_stage (p, STAGE_CONVERT);
+    if (!s)
+        return DC1394_FAILURE;
+    s->color_coding = color_coding;
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_pipeline_add_callback (dc1394pipeline_t * p,
+        dc1394pipeline_callback_t callback, void * user)
+{
+    pipeline_stage_t * s;
+
+    if (!callback)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+    s = add_stage (p, STAGE_CALLBACK);
+    if (!s)
+        return DC1394_FAILURE;
+    s->callback = callback;
+    s->user = user;
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_pipeline_start (dc1394pipeline_t * p)
+{
+    dc1394error_t err;
+    uint32_t i;
+
+    if (p->running)
+        return DC1394_CAPTURE_IS_RUNNING;
+    if (p->num_stages < 2) {
+        dc1394_log_error ("The pipeline has no stage to run");
+        return DC1394_FAILURE;
+    }
+
+    for (i = 1; i < p->num_stages; i++) {
+        pipeline_stage_t * s = p->stages + i;
+        s->in.closed = 0;
+        if (pthread_create (&s->thread, NULL, stage_thread, s) != 0) {
+            dc1394_log_error ("Failed to start pipeline stage %d", i);
+            p->running = 1;
+            dc1394_pipeline_stop (p);
+            return DC1394_FAILURE;
+        }
+        s->thread_started = 1;
+    }
+    p->stages[0].in.closed = 0;
+    p->running = 1;
+
+    err = dc1394_capture_start_async (p->camera, capture_callback, p, NULL);
+    if (err != DC1394_SUCCESS) {
+        dc1394_pipeline_stop (p);
+        return err;
+    }
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_pipeline_stop (dc1394pipeline_t * p)
+{
+    uint32_t i;
+
+    if (!p->running)
+        return DC1394_SUCCESS;
+
+    /* A capture callback waiting for a free item gives its frame back */
+    ring_close (&p->stages[0].in);
+    if (DC1394_CAMERA_PRIV (p->camera)->async)
+        dc1394_capture_stop_async (p->camera);
+
+    /* Drain the stages in order, so that every frame in flight reaches the
+     * end of the pipeline and its captured frame is given back */
+    for (i = 1; i < p->num_stages; i++) {
+        pipeline_stage_t * s = p->stages + i;
+        ring_close (&s->in);
+        if (s->thread_started)
+            pthread_join (s->thread, NULL);
+        s->thread_started = 0;
+    }
+
+    p->running = 0;
+    return DC1394_SUCCESS;
+}
+
+void
+dc1394_pipeline_free (dc1394pipeline_t * p)
+{
+    uint32_t i;
+
+    if (!p)
+        return;
+    dc1394_pipeline_stop (p);
+    for (i = 0; i < p->num_stages; i++)
+        ring_free (&p->stages[i].in);
+    if (p->items) {
+        for (i = 0; i < p->num_items; i++) {
+            free (p->items[i].work[0].image);
+            free (p->items[i].work[1].image);
+        }
+        free (p->items);
+    }
+    free (p);
+}
+
+dc1394error_t
+dc1394_pipeline_get_stats (dc1394pipeline_t * p, uint32_t stage,
+        dc1394pipeline_stats_t * stats)
+{
+    if (!stats || stage >= p->num_stages)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+    *stats = p->stages[stage].stats;
+    return DC1394_SUCCESS;
+}
+
+#else
+
+dc1394pipeline_t *
+dc1394_pipeline_new (dc1394camera_t * camera, uint32_t max_frames)
+{
+    dc1394_log_error ("Capture pipelines need POSIX threads");
+    return NULL;
+}
+
+dc1394error_t
+dc1394_pipeline_add_debayer (dc1394pipeline_t * p, dc1394bayer_method_t method,
+        dc1394color_filter_t color_filter)
+{
+    return DC1394_FUNCTION_NOT_SUPPORTED;
+}
+
+dc1394error_t
+dc1394_pipeline_add_convert (dc1394pipeline_t * p,
+        dc1394color_coding_t color_coding)
+{
+    return DC1394_FUNCTION_NOT_SUPPORTED;
+}
+
+dc1394error_t
+dc1394_pipeline_add_callback (dc1394pipeline_t * p,
+        dc1394pipeline_callback_t callback, void * user)
+{
+    return DC1394_FUNCTION_NOT_SUPPORTED;
+}
+
+dc1394error_t
+dc1394_pipeline_start (dc1394pipeline_t * p)
+{
+    return DC1394_FUNCTION_NOT_SUPPORTED;
+}
+
+dc1394error_t
+dc1394_pipeline_stop (dc1394pipeline_t * p)
+{
+    return DC1394_FUNCTION_NOT_SUPPORTED;
+}
+
+void
+dc1394_pipeline_free (dc1394pipeline_t * p)
+{
+}
+
+dc1394error_t
+dc1394_pipeline_get_stats (dc1394pipeline_t * p, uint32_t stage,
+        dc1394pipeline_stats_t * stats)
+{
+    return DC1394_FUNCTION_NOT_SUPPORTED;
+}
+
+#endif
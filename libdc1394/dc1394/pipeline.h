@@ -0,0 +1,115 @@
+/*
+ * 1394-Based Digital Camera Control Library
+ *
+ * Capture pipeline
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <dc1394/log.h>
+#include <dc1394/video.h>
+#include <dc1394/conversions.h>
+
+#ifndef __DC1394_PIPELINE_H__
+#define __DC1394_PIPELINE_H__
+
+/*! \file dc1394/pipeline.h
+    \brief Capture pipeline: frames processed by a chain of threads
+
+    The frames of a capturing camera are dequeued by the capture thread (stage 0) and go through the stages added to the
+    pipeline in turn, each stage running on a thread of its own. Stages are joined by bounded lock-free single-producer
+    single-consumer rings. The pipeline holds a fixed number of frames in flight: when the last stage falls behind, the
+    capture thread waits for a frame to come back, and the camera's ring buffer absorbs the difference (overruns then show
+    in dc1394_capture_get_stats()).
+
+    The captured frame goes back to the ring buffer as soon as the first conversion stage has copied it; later stages see
+    the converted frame.
+*/
+
+/**
+ * Opaque pipeline.
+ */
+typedef struct __dc1394pipeline_t dc1394pipeline_t;
+
+/**
+ * User stage of a pipeline. The frame is only valid until the callback returns.
+ */
+typedef void (*dc1394pipeline_callback_t)(dc1394video_frame_t *frame, void *user);
+
+/**
+ * Statistics of a pipeline stage. Times are in microseconds.
+ */
+typedef struct
+{
+    uint64_t                 frames;               /* frames processed by the stage */
+    uint64_t                 frames_failed;        /* frames the stage failed to convert, which skip the later stages */
+    uint64_t                 busy_time;            /* total time spent processing frames */
+    uint64_t                 wait_time;            /* total time frames waited in the ring before the stage */
+    uint32_t                 max_busy_time;        /* longest time spent on a frame */
+    uint64_t                 latency;              /* total time from the dequeue of a frame to the end of the stage */
+    uint32_t                 max_latency;          /* longest time from the dequeue of a frame to the end of the stage */
+} dc1394pipeline_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates a pipeline for a camera with at most max_frames frames in flight. The capture must be set up before
+ * dc1394_pipeline_start().
+ */
+dc1394pipeline_t * dc1394_pipeline_new(dc1394camera_t *camera, uint32_t max_frames);
+
+/**
+ * Adds a stage converting the frames with dc1394_debayer_frames().
+ */
+dc1394error_t dc1394_pipeline_add_debayer(dc1394pipeline_t *pipeline, dc1394bayer_method_t method,
+                                          dc1394color_filter_t color_filter);
+
+/**
+ * Adds a stage converting the frames to another color coding with dc1394_convert_frames().
+ */
+dc1394error_t dc1394_pipeline_add_convert(dc1394pipeline_t *pipeline, dc1394color_coding_t color_coding);
+
+/**
+ * Adds a stage calling a user function.
+ */
+dc1394error_t dc1394_pipeline_add_callback(dc1394pipeline_t *pipeline, dc1394pipeline_callback_t callback, void *user);
+
+/**
+ * Starts the capture thread and the stage threads. Stages can not be added afterwards.
+ */
+dc1394error_t dc1394_pipeline_start(dc1394pipeline_t *pipeline);
+
+/**
+ * Stops all the threads once the frames in flight have gone through the pipeline, and gives them back to the ring buffer.
+ */
+dc1394error_t dc1394_pipeline_stop(dc1394pipeline_t *pipeline);
+
+/**
+ * Stops the pipeline if needed and frees it.
+ */
+void dc1394_pipeline_free(dc1394pipeline_t *pipeline);
+
+/**
+ * Gets the statistics of a stage. Stage 0 is the capture thread, the stages added follow in order.
+ */
+dc1394error_t dc1394_pipeline_get_stats(dc1394pipeline_t *pipeline, uint32_t stage, dc1394pipeline_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -25,6 +25,7 @@
 
 #include <stdint.h>
 #include <dc1394/camera.h>
+#include <dc1394/register.h>
 
 typedef struct _platform_t platform_t;
 typedef struct _platform_device_t platform_device_t;
@@ -53,6 +54,12 @@ typedef struct _platform_dispatch_t {
             uint32_t *, int);
     dc1394error_t (*camera_write)(platform_camera_t *, uint64_t,
             const uint32_t *, int);
+    dc1394error_t (*camera_read_vector)(platform_camera_t *,
+            dc1394register_io_t *, uint32_t);
+    dc1394error_t (*camera_write_vector)(platform_camera_t *,
+            const dc1394register_io_t *, uint32_t);
+    void (*camera_write_group)(platform_camera_t **, const uint64_t *,
+            uint32_t, uint32_t, dc1394error_t *, uint64_t *);
 
     dc1394error_t (*reset_bus)(platform_camera_t *);
     dc1394error_t (*read_cycle_timer)(platform_camera_t *, uint32_t *,
@@ -60,6 +67,7 @@ typedef struct _platform_dispatch_t {
     dc1394error_t (*camera_get_node)(platform_camera_t *, uint32_t *,
             uint32_t *);
     dc1394error_t (*camera_print_info)(platform_camera_t *, FILE *);
+    dc1394error_t (*camera_get_bus)(platform_camera_t *, uint32_t *);
     dc1394error_t (*set_broadcast)(platform_camera_t *, dc1394bool_t);
     dc1394error_t (*get_broadcast)(platform_camera_t *, dc1394bool_t *);
 
@@ -74,6 +82,16 @@ typedef struct _platform_dispatch_t {
     int (*capture_get_fileno)(platform_camera_t *);
     dc1394bool_t (*capture_is_frame_corrupt)(platform_camera_t *,
             dc1394video_frame_t *);
+    dc1394error_t (*capture_retain)(platform_camera_t *,
+            dc1394video_frame_t *);
+    dc1394error_t (*capture_release)(platform_camera_t *,
+            dc1394video_frame_t *);
+    dc1394error_t (*capture_set_partial_delivery)(platform_camera_t *,
+            uint32_t);
+    dc1394error_t (*capture_wait_rows)(platform_camera_t *,
+            dc1394video_frame_t *, uint32_t, dc1394capture_policy_t);
+    dc1394error_t (*capture_grow)(platform_camera_t *, uint32_t);
+    dc1394error_t (*capture_reconfigure)(platform_camera_t *);
 
     dc1394error_t (*iso_set_persist)(platform_camera_t *);
     dc1394error_t (*iso_allocate_channel)(platform_camera_t *, uint64_t,
@@ -0,0 +1,424 @@
+/*
+ * 1394-Based Digital Camera Control Library
+ *
+ * Camera profiles
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "control.h"
+#include "video.h"
+#include "format7.h"
+#include "register.h"
+#include "utils.h"
+#include "profile.h"
+#include "internal.h"
+#include "offsets.h"
+
+#define FEATURE_ABS_CONTROL 0x40000000UL
+#define FEATURE_ONE_PUSH    0x04000000UL
+#define FEATURE_ON_OFF      0x02000000UL
+#define FEATURE_AUTO        0x01000000UL
+#define TRIGGER_POLARITY    0x01000000UL
+
+/* The state the camera is known to be in */
+typedef struct _profile_snapshot_t {
+    uint32_t generation;
+    dc1394profile_t profile;
+    uint32_t feature_regs[FEATURE_BLOCK_QUADS];  /* value registers of the features */
+} profile_snapshot_t;
+
+void
+profile_free (dc1394camera_t * camera)
+{
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+
+    free (cpriv->profile);
+    cpriv->profile = NULL;
+    cpriv->profile_valid = 0;
+}
+
+static uint64_t
+feature_register_offset (dc1394camera_t * camera, int index)
+{
+    return camera->command_registers_base + REG_CAMERA_FEATURE_HI_BASE +
+        index * 4U;
+}
+
+static dc1394error_t
+read_snapshot (dc1394camera_t * camera, profile_snapshot_t * s)
+{
+    dc1394profile_t * p = &s->profile;
+    dc1394register_io_t ios[DC1394_FEATURE_NUM];
+    uint32_t packet_size, num = 0, i;
+    dc1394error_t err;
+
+    memset (s, 0, sizeof *s);
+    dc1394_camera_get_node (camera, NULL, &s->generation);
+
+    err = dc1394_video_get_mode (camera, &p->video_mode);
+    DC1394_ERR_RTN (err, "Could not get the video mode");
+    if (dc1394_is_video_mode_scalable (p->video_mode)) {
+        err = dc1394_format7_get_roi (camera, p->video_mode, &p->color_coding,
+                &packet_size, &p->left, &p->top, &p->width, &p->height);
+        DC1394_ERR_RTN (err, "Could not get the Format_7 ROI");
+        p->packet_size = packet_size;
+    }
+    else {
+        err = dc1394_video_get_framerate (camera, &p->framerate);
+        DC1394_ERR_RTN (err, "Could not get the framerate");
+    }
+
+    err = dc1394_feature_get_all (camera, &p->features);
+    DC1394_ERR_RTN (err, "Could not get the features");
+
+    /* The raw registers keep the bits the profiles do not deal with */
+    for (i = 0; i < DC1394_FEATURE_NUM; i++) {
+        dc1394feature_info_t * f = &p->features.feature[i];
+        int index = feature_register_index (f->id);
+
+        if (!f->available)
+            continue;
+        ios[num].offset = feature_register_offset (camera, index);
+        ios[num].num_regs = 1;
+        ios[num].value = &s->feature_regs[index];
+        num++;
+    }
+    err = dc1394_get_registers_vector (camera, ios, num);
+    DC1394_ERR_RTN (err, "Could not get the feature registers");
+
+    return DC1394_SUCCESS;
+}
+
+/* Returns the state of the camera, read again unless the library kept it
+ * up to date since the last time */
+static dc1394error_t
+get_snapshot (dc1394camera_t * camera, profile_snapshot_t ** snapshot)
+{
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+    uint32_t generation;
+    dc1394error_t err;
+
+    if (!cpriv->profile) {
+        cpriv->profile = malloc (sizeof *cpriv->profile);
+        if (!cpriv->profile)
+            return DC1394_MEMORY_ALLOCATION_FAILURE;
+        cpriv->profile_valid = 0;
+    }
+
+    if (cpriv->profile_valid &&
+            dc1394_camera_get_node (camera, NULL, &generation) == DC1394_SUCCESS &&
+            generation != cpriv->profile->generation)
+        cpriv->profile_valid = 0;
+
+    if (!cpriv->profile_valid) {
+        err = read_snapshot (camera, cpriv->profile);
+        DC1394_ERR_RTN (err, "Could not read the state of the camera");
+        cpriv->profile_valid = 1;
+    }
+
+    *snapshot = cpriv->profile;
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_profile_get (dc1394camera_t * camera, dc1394profile_t * profile)
+{
+    profile_snapshot_t * s;
+    dc1394error_t err;
+
+    DC1394_CAMERA_PRIV (camera)->profile_valid = 0;
+    err = get_snapshot (camera, &s);
+    if (err != DC1394_SUCCESS)
+        return err;
+    *profile = s->profile;
+    return DC1394_SUCCESS;
+}
+
+/* Builds the value register of a feature in the state f from its current
+ * register, given the capabilities of the camera in cap */
+static uint32_t
+encode_feature (const dc1394feature_info_t * cap,
+        const dc1394feature_info_t * f, uint32_t reg)
+{
+    uint32_t mode, source, polarity;
+
+    if (cap->on_off_capable)
+        reg = (reg & ~FEATURE_ON_OFF) | (f->is_on ? FEATURE_ON_OFF : 0);
+
+    if (f->id == DC1394_FEATURE_TRIGGER) {
+        mode = f->trigger_mode - DC1394_TRIGGER_MODE_MIN;
+        if (mode > 5)
+            mode += 8;
+        source = f->trigger_source - DC1394_TRIGGER_SOURCE_MIN;
+        if (source > 3)
+            source += 3;
+        /* dc1394_feature_get_all() reports the polarity as a boolean */
+        if (f->trigger_polarity >= DC1394_TRIGGER_ACTIVE_MIN)
+            polarity = f->trigger_polarity - DC1394_TRIGGER_ACTIVE_MIN;
+        else
+            polarity = f->trigger_polarity ? 1 : 0;
+        if (cap->polarity_capable)
+            reg = (reg & ~TRIGGER_POLARITY) | (polarity ? TRIGGER_POLARITY : 0);
+        return (reg & 0xFF10F000UL) | ((source & 0x7UL) << 21) |
+            ((mode & 0xFUL) << 16) | (f->value & 0xFFFUL);
+    }
+
+    reg &= ~(FEATURE_AUTO | FEATURE_ONE_PUSH);
+    if (f->current_mode == DC1394_FEATURE_MODE_AUTO)
+        reg |= FEATURE_AUTO;
+    else if (f->current_mode == DC1394_FEATURE_MODE_ONE_PUSH_AUTO)
+        reg |= FEATURE_ONE_PUSH;
+    if (cap->absolute_capable)
+        reg = (reg & ~FEATURE_ABS_CONTROL) | (f->abs_control ? FEATURE_ABS_CONTROL : 0);
+
+    /* The value is the camera's business in the automatic modes, and comes
+     * from the absolute register under absolute control */
+    if (f->current_mode != DC1394_FEATURE_MODE_MANUAL ||
+            (reg & FEATURE_ABS_CONTROL))
+        return reg;
+
+    switch (f->id) {
+    case DC1394_FEATURE_WHITE_BALANCE:
+        return (reg & 0xFF000000UL) | ((f->BU_value & 0xFFFUL) << 12) |
+            (f->RV_value & 0xFFFUL);
+    case DC1394_FEATURE_WHITE_SHADING:
+        return (reg & 0xFF000000UL) | ((f->B_value & 0xFFUL) << 16) |
+            ((f->G_value & 0xFFUL) << 8) | (f->R_value & 0xFFUL);
+    case DC1394_FEATURE_TEMPERATURE:
+        /* target_value is reported in place, the current value is read-only */
+        return (reg & 0xFF000FFFUL) | (f->target_value & 0xFFF000UL);
+    default:
+        return (reg & 0xFFFFF000UL) | (f->value & 0xFFFUL);
+    }
+}
+
+/* Writes the feature registers marked in changed, contiguous ones with a
+ * block write.  Cameras that refuse block writes get them one by one. */
+static dc1394error_t
+write_feature_registers (dc1394camera_t * camera, uint32_t * regs,
+        const int * changed)
+{
+    dc1394register_io_t ios[FEATURE_BLOCK_QUADS];
+    uint32_t num = 0, blocks = 0;
+    dc1394error_t err;
+    int i;
+
+    for (i = 0; i < FEATURE_BLOCK_QUADS; i++) {
+        if (!changed[i])
+            continue;
+        if (num && changed[i - 1]) {
+            ios[num - 1].num_regs++;
+            blocks = 1;
+            continue;
+        }
+        ios[num].offset = feature_register_offset (camera, i);
+        ios[num].num_regs = 1;
+        ios[num].value = regs + i;
+        num++;
+    }
+
+    err = dc1394_set_registers_vector (camera, ios, num);
+    if (err == DC1394_SUCCESS || !blocks)
+        return err;
+
+    dc1394_log_debug ("Block writes of the feature registers failed, writing each feature");
+    for (i = 0, num = 0; i < FEATURE_BLOCK_QUADS; i++) {
+        if (!changed[i])
+            continue;
+        ios[num].offset = feature_register_offset (camera, i);
+        ios[num].num_regs = 1;
+        ios[num].value = regs + i;
+        num++;
+    }
+    return dc1394_set_registers_vector (camera, ios, num);
+}
+
+static int
+video_differs (const dc1394profile_t * a, const dc1394profile_t * b)
+{
+    if (a->video_mode != b->video_mode)
+        return 1;
+    if (!dc1394_is_video_mode_scalable (a->video_mode))
+        return a->framerate != b->framerate;
+    return a->color_coding != b->color_coding ||
+        a->packet_size != b->packet_size ||
+        a->left != b->left || a->top != b->top ||
+        a->width != b->width || a->height != b->height;
+}
+
+/* Copies the settings of a feature, leaving its capabilities alone */
+static void
+merge_feature (dc1394feature_info_t * dst, const dc1394feature_info_t * src)
+{
+    dst->is_on = src->is_on;
+    dst->current_mode = src->current_mode;
+    dst->trigger_mode = src->trigger_mode;
+    dst->trigger_polarity = src->trigger_polarity;
+    dst->trigger_source = src->trigger_source;
+    dst->value = src->value;
+    dst->BU_value = src->BU_value;
+    dst->RV_value = src->RV_value;
+    dst->B_value = src->B_value;
+    dst->R_value = src->R_value;
+    dst->G_value = src->G_value;
+    dst->target_value = src->target_value;
+    dst->abs_control = src->abs_control;
+    dst->abs_value = src->abs_value;
+}
+
+dc1394error_t
+dc1394_profile_apply (dc1394camera_t * camera, const dc1394profile_t * profile)
+{
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+    profile_snapshot_t * s;
+    dc1394profile_t * cur;
+    uint32_t regs[FEATURE_BLOCK_QUADS];
+    int changed[FEATURE_BLOCK_QUADS], trigger_changed[FEATURE_BLOCK_QUADS];
+    dc1394register_io_t abs_ios[DC1394_FEATURE_NUM];
+    uint32_t abs_values[DC1394_FEATURE_NUM];
+    uint32_t num_abs = 0, i;
+    int trigger = feature_register_index (DC1394_FEATURE_TRIGGER);
+    int trigger_first = 0, video, one_push = 0;
+    dc1394switch_t iso;
+    dc1394error_t err;
+
+    if (!profile)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+
+    err = get_snapshot (camera, &s);
+    if (err != DC1394_SUCCESS)
+        return err;
+    cur = &s->profile;
+
+    video = video_differs (profile, cur);
+    if (video) {
+        err = dc1394_video_get_transmission (camera, &iso);
+        DC1394_ERR_RTN (err, "Could not get the ISO status");
+        if (iso == DC1394_ON) {
+            dc1394_log_error ("The video settings can not change while the camera transmits");
+            return DC1394_CAPTURE_IS_RUNNING;
+        }
+    }
+
+    /* Work out the registers that change */
+    memcpy (regs, s->feature_regs, sizeof regs);
+    memset (changed, 0, sizeof changed);
+    memset (trigger_changed, 0, sizeof trigger_changed);
+    for (i = 0; i < DC1394_FEATURE_NUM; i++) {
+        const dc1394feature_info_t * f = &profile->features.feature[i];
+        const dc1394feature_info_t * cap = &cur->features.feature[i];
+        int index = feature_register_index (cap->id);
+
+        if (!f->available || !cap->available || f->id != cap->id)
+            continue;
+
+        regs[index] = encode_feature (cap, f, s->feature_regs[index]);
+        if (regs[index] & FEATURE_ONE_PUSH)
+            one_push = 1;
+        if (regs[index] == s->feature_regs[index] && !(regs[index] & FEATURE_ONE_PUSH))
+            continue;
+        if (index == trigger)
+            trigger_changed[index] = 1;
+        else
+            changed[index] = 1;
+    }
+
+    for (i = 0; i < DC1394_FEATURE_NUM; i++) {
+        const dc1394feature_info_t * f = &profile->features.feature[i];
+        const dc1394feature_info_t * cap = &cur->features.feature[i];
+        uint64_t absoffset;
+
+        if (!f->available || !cap->available || f->id != cap->id ||
+                !cap->absolute_capable || !f->abs_control ||
+                f->current_mode != DC1394_FEATURE_MODE_MANUAL)
+            continue;
+        memcpy (&abs_values[num_abs], &f->abs_value, 4);
+        if (cap->abs_control && !memcmp (&f->abs_value, &cap->abs_value, 4))
+            continue;
+        err = QueryAbsoluteCSROffset (camera, f->id, &absoffset);
+        DC1394_ERR_RTN (err, "Could not get feature absolute CSR offset");
+        abs_ios[num_abs].offset = absoffset + REG_CAMERA_ABS_VALUE;
+        abs_ios[num_abs].num_regs = 1;
+        abs_ios[num_abs].value = &abs_values[num_abs];
+        num_abs++;
+    }
+
+    /* The trigger goes off before anything else changes */
+    if (trigger_changed[trigger] && !(regs[trigger] & FEATURE_ON_OFF)) {
+        err = write_feature_registers (camera, regs, trigger_changed);
+        DC1394_ERR_RTN (err, "Could not set the trigger");
+        trigger_first = 1;
+    }
+
+    /* The video mode goes first, then the frame rate or the ROI, which
+     * dc1394_format7_set_roi() orders by itself */
+    if (video) {
+        if (profile->video_mode != cur->video_mode) {
+            err = dc1394_video_set_mode (camera, profile->video_mode);
+            DC1394_ERR_RTN (err, "Could not set the video mode");
+        }
+        if (dc1394_is_video_mode_scalable (profile->video_mode))
+            err = dc1394_format7_set_roi (camera, profile->video_mode,
+                    profile->color_coding, profile->packet_size,
+                    profile->left, profile->top, profile->width, profile->height);
+        else
+            err = dc1394_video_set_framerate (camera, profile->framerate);
+        DC1394_ERR_RTN (err, "Could not set the video settings");
+    }
+
+    /* Absolute control is switched on before the absolute values change */
+    err = write_feature_registers (camera, regs, changed);
+    DC1394_ERR_RTN (err, "Could not set the features");
+    err = dc1394_set_registers_vector (camera, abs_ios, num_abs);
+    DC1394_ERR_RTN (err, "Could not set the absolute values of the features");
+
+    /* and the trigger goes on once everything is in place */
+    if (trigger_changed[trigger] && !trigger_first) {
+        err = write_feature_registers (camera, regs, trigger_changed);
+        DC1394_ERR_RTN (err, "Could not set the trigger");
+    }
+
+    /* The writes above cleared profile_valid: the camera is now in the
+     * state of the profile, unless a one-push feature is still adjusting */
+    if (video) {
+        cur->video_mode = profile->video_mode;
+        cur->framerate = profile->framerate;
+        cur->color_coding = profile->color_coding;
+        cur->packet_size = profile->packet_size;
+        cur->left = profile->left;
+        cur->top = profile->top;
+        cur->width = profile->width;
+        cur->height = profile->height;
+    }
+    for (i = 0; i < DC1394_FEATURE_NUM; i++) {
+        const dc1394feature_info_t * f = &profile->features.feature[i];
+        dc1394feature_info_t * cap = &cur->features.feature[i];
+
+        if (f->available && cap->available && f->id == cap->id)
+            merge_feature (cap, f);
+    }
+    memcpy (s->feature_regs, regs, sizeof regs);
+    cpriv->profile_valid = !one_push;
+
+    return DC1394_SUCCESS;
+}
@@ -0,0 +1,78 @@
+/*
+ * 1394-Based Digital Camera Control Library
+ *
+ * Camera profiles
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <dc1394/log.h>
+#include <dc1394/control.h>
+#include <dc1394/video.h>
+#include <dc1394/format7.h>
+
+#ifndef __DC1394_PROFILE_H__
+#define __DC1394_PROFILE_H__
+
+/*! \file dc1394/profile.h
+    \brief Camera profiles: the settings of a camera applied in one go
+
+    A profile holds the video mode, the frame rate or the Format_7 region of interest, and the state of the features,
+    trigger included. Applying a profile only writes the registers that differ from the state the camera is known to be
+    in. That state is read once, then kept up to date by the library until a register is written by other means, the
+    camera is reset or the bus is reset. Contiguous feature registers are written with block writes where the camera
+    accepts them, and the writes are ordered so that the camera never runs in a mix of the old and new settings: the
+    trigger is switched off first and on last, the video mode goes before the frame rate or the region of interest, and
+    absolute control is switched on before the absolute values are written.
+*/
+
+/**
+ * The settings of a camera.
+ */
+typedef struct
+{
+    dc1394video_mode_t       video_mode;
+    dc1394framerate_t        framerate;            /* for the video modes of Formats 0 to 2 */
+    dc1394color_coding_t     color_coding;         /* Format_7 only, like the fields below */
+    int32_t                  packet_size;          /* bytes per packet, or DC1394_USE_RECOMMENDED or DC1394_USE_MAX_AVAIL */
+    uint32_t                 left;
+    uint32_t                 top;
+    uint32_t                 width;
+    uint32_t                 height;
+    dc1394featureset_t       features;             /* features with available set to DC1394_FALSE are left alone */
+} dc1394profile_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Reads the current settings of a camera into a profile.
+ */
+dc1394error_t dc1394_profile_get(dc1394camera_t *camera, dc1394profile_t *profile);
+
+/**
+ * Applies a profile. The video settings can only change while the camera is not transmitting
+ * (DC1394_CAPTURE_IS_RUNNING is returned otherwise). Only the fields of the features that matter in their mode are
+ * written: the value of a feature in auto mode is left to the camera. A feature in one-push mode is triggered again at
+ * each call.
+ */
+dc1394error_t dc1394_profile_apply(dc1394camera_t *camera, const dc1394profile_t *profile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -21,11 +21,14 @@
  */
 
 #include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
 #include "control.h"
 #include "internal.h"
 #include "offsets.h"
 #include "register.h"
 #include "utils.h"
+#include "platform.h"
 #include "config.h"
 
 /* Note: debug modes can be very verbose. */
@@ -59,6 +62,172 @@
     offset+= feature * 0x04U;                                         \
     }
 
+/* Inquiry registers of the command register space, which never change */
+#define IS_INQUIRY_RANGE(offset, end, lo, hi) ((offset) >= (lo) && (end) <= (hi))
+
+static int
+is_inquiry_register (uint64_t offset, uint32_t num_regs)
+{
+    uint64_t end = offset + num_regs * 4;
+
+    return IS_INQUIRY_RANGE (offset, end, REG_CAMERA_V_FORMAT_INQ,
+                REG_CAMERA_V_CSR_INQ_BASE + 0x20U) ||
+        IS_INQUIRY_RANGE (offset, end, REG_CAMERA_BASIC_FUNC_INQ,
+                REG_CAMERA_STROBE_CONTROL_CSR_INQ + 0x04U) ||
+        IS_INQUIRY_RANGE (offset, end, REG_CAMERA_FEATURE_HI_BASE_INQ,
+                REG_CAMERA_FEATURE_LO_BASE_INQ + 0x80U) ||
+        IS_INQUIRY_RANGE (offset, end, REG_CAMERA_FEATURE_ABS_HI_BASE,
+                REG_CAMERA_FEATURE_ABS_LO_BASE + 0x80U);
+}
+
+static int
+is_format7_inquiry_register (uint64_t offset)
+{
+    return offset == REG_CAMERA_FORMAT7_MAX_IMAGE_SIZE_INQ ||
+        offset == REG_CAMERA_FORMAT7_UNIT_SIZE_INQ ||
+        offset == REG_CAMERA_FORMAT7_COLOR_CODING_INQ ||
+        offset == REG_CAMERA_FORMAT7_UNIT_POSITION_INQ;
+}
+
+/********************************************************************************/
+/* Inquiry register cache                                                       */
+/********************************************************************************/
+
+static uint32_t
+cache_slot (register_cache_t * c, uint64_t offset)
+{
+    uint32_t i = ((uint32_t) (offset >> 2) * 2654435761U) & (c->size - 1);
+
+    while (c->offsets[i] && c->offsets[i] != offset)
+        i = (i + 1) & (c->size - 1);
+    return i;
+}
+
+static void
+cache_store (register_cache_t * c, uint64_t offset, uint32_t value)
+{
+    uint32_t i;
+
+    if (2 * (c->count + 1) > c->size) {
+        register_cache_t n = *c;
+        n.size = c->size ? 2 * c->size : 64;
+        n.count = 0;
+        n.offsets = calloc (n.size, sizeof *n.offsets);
+        n.values = malloc (n.size * sizeof *n.values);
+        if (!n.offsets || !n.values) {
+            free (n.offsets);
+            free (n.values);
+            return;
+        }
+        for (i = 0; i < c->size; i++)
+            if (c->offsets[i]) {
+                uint32_t j = cache_slot (&n, c->offsets[i]);
+                n.offsets[j] = c->offsets[i];
+                n.values[j] = c->values[i];
+                n.count++;
+            }
+        free (c->offsets);
+        free (c->values);
+        *c = n;
+    }
+
+    i = cache_slot (c, offset);
+    if (!c->offsets[i])
+        c->count++;
+    c->offsets[i] = offset;
+    c->values[i] = value;
+}
+
+#ifdef HAVE_PTHREAD_H
+#define CACHE_LOCK(c)   pthread_mutex_lock (&(c)->lock)
+#define CACHE_UNLOCK(c) pthread_mutex_unlock (&(c)->lock)
+#else
+#define CACHE_LOCK(c)
+#define CACHE_UNLOCK(c)
+#endif
+
+static void
+cache_clear (register_cache_t * c)
+{
+    if (c->count)
+        memset (c->offsets, 0, c->size * sizeof *c->offsets);
+    c->count = 0;
+}
+
+void
+register_cache_init (dc1394camera_t * camera)
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_init (&DC1394_CAMERA_PRIV (camera)->register_cache.lock, NULL);
+#endif
+}
+
+void
+register_cache_invalidate (dc1394camera_t * camera)
+{
+    register_cache_t * c = &DC1394_CAMERA_PRIV (camera)->register_cache;
+
+    CACHE_LOCK (c);
+    cache_clear (c);
+    CACHE_UNLOCK (c);
+}
+
+void
+register_cache_free (dc1394camera_t * camera)
+{
+    register_cache_t * c = &DC1394_CAMERA_PRIV (camera)->register_cache;
+
+    free (c->offsets);
+    free (c->values);
+    c->offsets = NULL;
+    c->values = NULL;
+    c->size = c->count = 0;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_destroy (&c->lock);
+#endif
+}
+
+/* Reads inquiry registers, from the cache when they were read before. The
+ * offset is relative to the config ROM base, like dc1394_get_registers(). */
+dc1394error_t
+register_cache_read (dc1394camera_t * camera, uint64_t offset,
+        uint32_t * value, uint32_t num_regs)
+{
+    register_cache_t * c = &DC1394_CAMERA_PRIV (camera)->register_cache;
+    uint32_t generation, i;
+    dc1394error_t err;
+
+    int got_generation;
+
+    got_generation = dc1394_camera_get_node (camera, NULL, &generation) ==
+        DC1394_SUCCESS;
+
+    CACHE_LOCK (c);
+    if (got_generation && generation != c->generation) {
+        cache_clear (c);
+        c->generation = generation;
+    }
+    for (i = 0; c->count && i < num_regs; i++) {
+        uint32_t slot = cache_slot (c, offset + i * 4);
+        if (!c->offsets[slot])
+            break;
+        value[i] = c->values[slot];
+    }
+    CACHE_UNLOCK (c);
+    if (i == num_regs && num_regs)
+        return DC1394_SUCCESS;
+
+    /* Read without the lock, so that other threads are not held up */
+    err = dc1394_get_registers (camera, offset, value, num_regs);
+    if (err != DC1394_SUCCESS)
+        return err;
+    CACHE_LOCK (c);
+    if (!got_generation || generation == c->generation)
+        for (i = 0; i < num_regs; i++)
+            cache_store (c, offset + i * 4, value[i]);
+    CACHE_UNLOCK (c);
+    return DC1394_SUCCESS;
+}
 
 dc1394error_t
 dc1394_get_registers (dc1394camera_t *camera, uint64_t offset,
@@ -82,11 +251,233 @@ dc1394_set_registers (dc1394camera_t *camera, uint64_t offset,
     if (camera == NULL)
         return DC1394_CAMERA_NOT_INITIALIZED;
 
+    cp->profile_valid = 0;
     return cp->platform->dispatch->camera_write (cp->pcam, offset, value,
             num_regs);
 }
 
 
+/********************************************************************************/
+/* Vectored access                                                              */
+/********************************************************************************/
+
+/* Largest block read made by merging ranges */
+#define VECTOR_MAX_BLOCK_QUADS 128
+
+static int
+compare_io_offsets (const void * a, const void * b)
+{
+    const dc1394register_io_t * x = *(const dc1394register_io_t * const *) a;
+    const dc1394register_io_t * y = *(const dc1394register_io_t * const *) b;
+
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+static dc1394error_t
+read_vector (dc1394camera_t * camera, dc1394register_io_t * ios, uint32_t num)
+{
+    dc1394camera_priv_t * cp = DC1394_CAMERA_PRIV (camera);
+    const platform_dispatch_t * d = cp->platform->dispatch;
+    dc1394error_t err;
+    uint32_t i;
+
+    if (d->camera_read_vector)
+        return d->camera_read_vector (cp->pcam, ios, num);
+    for (i = 0; i < num; i++) {
+        err = d->camera_read (cp->pcam, ios[i].offset, ios[i].value,
+                ios[i].num_regs);
+        if (err != DC1394_SUCCESS)
+            return err;
+    }
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_get_registers_vector (dc1394camera_t *camera, dc1394register_io_t *ios,
+                             uint32_t num_ios)
+{
+    dc1394register_io_t ** sorted = NULL;
+    dc1394register_io_t * blocks = NULL;
+    uint32_t * data = NULL;
+    uint32_t * block_of = NULL;
+    uint32_t num_blocks = 0, total = 0;
+    dc1394error_t err = DC1394_MEMORY_ALLOCATION_FAILURE;
+    uint32_t i;
+
+    if (camera == NULL)
+        return DC1394_CAMERA_NOT_INITIALIZED;
+    if (num_ios == 0)
+        return DC1394_SUCCESS;
+
+    sorted = malloc (num_ios * sizeof *sorted);
+    blocks = malloc (num_ios * sizeof *blocks);
+    block_of = malloc (num_ios * sizeof *block_of);
+    if (!sorted || !blocks || !block_of)
+        goto out;
+    for (i = 0; i < num_ios; i++) {
+        sorted[i] = ios + i;
+        total += ios[i].num_regs;
+    }
+    qsort (sorted, num_ios, sizeof *sorted, compare_io_offsets);
+
+    /* Merge the ranges that touch or overlap into blocks */
+    for (i = 0; i < num_ios; i++) {
+        dc1394register_io_t * io = sorted[i];
+        dc1394register_io_t * b = num_blocks ? blocks + num_blocks - 1 : NULL;
+        uint64_t end = io->offset + io->num_regs * 4;
+
+        if (b && io->offset <= b->offset + b->num_regs * 4 &&
+                end - b->offset <= VECTOR_MAX_BLOCK_QUADS * 4) {
+            if (end > b->offset + b->num_regs * 4)
+                b->num_regs = (end - b->offset) / 4;
+        }
+        else {
+            b = blocks + num_blocks++;
+            b->offset = io->offset;
+            b->num_regs = io->num_regs;
+        }
+        block_of[io - ios] = num_blocks - 1;
+    }
+
+    /* Nothing merged: read straight into the buffers of the caller */
+    if (num_blocks == num_ios) {
+        free (sorted);
+        free (blocks);
+        free (block_of);
+        err = read_vector (camera, ios, num_ios);
+        if (err != DC1394_SUCCESS)
+            goto one_by_one;
+        return err;
+    }
+
+    data = malloc (total * sizeof *data);
+    if (!data)
+        goto out;
+    total = 0;
+    for (i = 0; i < num_blocks; i++) {
+        blocks[i].value = data + total;
+        total += blocks[i].num_regs;
+    }
+
+    err = read_vector (camera, blocks, num_blocks);
+    if (err == DC1394_SUCCESS)
+        for (i = 0; i < num_ios; i++) {
+            dc1394register_io_t * b = blocks + block_of[i];
+            memcpy (ios[i].value, b->value + (ios[i].offset - b->offset) / 4,
+                    ios[i].num_regs * sizeof *ios[i].value);
+        }
+
+ out:
+    free (data);
+    free (sorted);
+    free (blocks);
+    free (block_of);
+    if (err == DC1394_MEMORY_ALLOCATION_FAILURE || err == DC1394_SUCCESS)
+        return err;
+
+ one_by_one:
+    dc1394_log_debug ("Vectored read failed, reading each quadlet");
+    for (i = 0; i < num_ios; i++) {
+        uint32_t j;
+        for (j = 0; j < ios[i].num_regs; j++) {
+            err = dc1394_get_registers (camera, ios[i].offset + j * 4,
+                    ios[i].value + j, 1);
+            if (err != DC1394_SUCCESS)
+                return err;
+        }
+    }
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_set_registers_vector (dc1394camera_t *camera,
+                             const dc1394register_io_t *ios, uint32_t num_ios)
+{
+    dc1394camera_priv_t * cp = DC1394_CAMERA_PRIV (camera);
+    const platform_dispatch_t * d;
+    dc1394error_t err;
+    uint32_t i;
+
+    if (camera == NULL)
+        return DC1394_CAMERA_NOT_INITIALIZED;
+    if (num_ios == 0)
+        return DC1394_SUCCESS;
+
+    cp->profile_valid = 0;
+    d = cp->platform->dispatch;
+    if (d->camera_write_vector)
+        return d->camera_write_vector (cp->pcam, ios, num_ios);
+    for (i = 0; i < num_ios; i++) {
+        err = d->camera_write (cp->pcam, ios[i].offset, ios[i].value,
+                ios[i].num_regs);
+        if (err != DC1394_SUCCESS)
+            return err;
+    }
+    return DC1394_SUCCESS;
+}
+
+/* Writes the same quadlet at the same offset from the command registers of
+ * several cameras.  When their platform can keep the requests of several
+ * cameras in flight (Juju), all the writes are sent before the first
+ * response is waited for; otherwise the cameras are written one after the
+ * other.  errs and times receive the status of each write and the unix time
+ * it completed at. */
+void
+control_register_write_group (dc1394camera_t ** cameras, uint32_t num,
+        uint64_t offset, uint32_t value, dc1394error_t * errs,
+        uint64_t * times)
+{
+    const platform_dispatch_t * d =
+        DC1394_CAMERA_PRIV (cameras[0])->platform->dispatch;
+    platform_camera_t ** pcams;
+    uint64_t * offsets;
+    uint32_t i;
+
+    for (i = 0; i < num; i++)
+        if (DC1394_CAMERA_PRIV (cameras[i])->platform->dispatch != d)
+            break;
+    if (i == num && d->camera_write_group) {
+        pcams = malloc (num * sizeof *pcams);
+        offsets = malloc (num * sizeof *offsets);
+        if (pcams && offsets) {
+            for (i = 0; i < num; i++) {
+                dc1394camera_priv_t * cp = DC1394_CAMERA_PRIV (cameras[i]);
+                cp->profile_valid = 0;
+                pcams[i] = cp->pcam;
+                offsets[i] = cameras[i]->command_registers_base + offset;
+            }
+            d->camera_write_group (pcams, offsets, num, value, errs, times);
+            free (pcams);
+            free (offsets);
+            return;
+        }
+        free (pcams);
+        free (offsets);
+    }
+
+    for (i = 0; i < num; i++) {
+        errs[i] = dc1394_set_control_register (cameras[i], offset, value);
+        times[i] = capture_get_time_usec ();
+    }
+}
+
+/* Base address of the Format_7 CSR of a mode, queried once */
+dc1394error_t
+get_format7_csr_base (dc1394camera_t *camera, dc1394video_mode_t mode,
+                      uint64_t *base)
+{
+    uint64_t * csr;
+
+    if (!dc1394_is_video_mode_scalable(mode))
+        return DC1394_INVALID_VIDEO_FORMAT;
+
+    csr = &camera->format7_csr[mode-DC1394_VIDEO_MODE_FORMAT7_MIN];
+    if (*csr == 0 && QueryFormat7CSROffset(camera, mode, csr) != DC1394_SUCCESS)
+        return DC1394_FAILURE;
+    *base = *csr;
+    return DC1394_SUCCESS;
+}
+
 /********************************************************************************/
 /* Get/Set Command Registers                                                    */
 /********************************************************************************/
@@ -94,6 +485,13 @@ dc1394error_t
 dc1394_get_control_registers (dc1394camera_t *camera, uint64_t offset,
                               uint32_t *value, uint32_t num_regs)
 {
+    if (camera == NULL)
+        return DC1394_CAMERA_NOT_INITIALIZED;
+
+    if (is_inquiry_register (offset, num_regs))
+        return register_cache_read (camera,
+            camera->command_registers_base + offset, value, num_regs);
+
     return dc1394_get_registers (camera,
         camera->command_registers_base + offset, value, num_regs);
 }
@@ -165,6 +563,11 @@ dc1394_get_format7_register(dc1394camera_t *camera, unsigned int mode, uint64_t
         }
     }
 
+    if (is_format7_inquiry_register (offset))
+        return register_cache_read (camera,
+            camera->format7_csr[mode-DC1394_VIDEO_MODE_FORMAT7_MIN]+offset,
+            value, 1);
+
     return dc1394_get_registers (camera,
         camera->format7_csr[mode-DC1394_VIDEO_MODE_FORMAT7_MIN]+offset,
         value, 1);
@@ -31,6 +31,16 @@
     More details soon
 */
 
+/**
+ * One range of registers of a vectored access. The offset is relative to the config ROM base, as for
+ * dc1394_get_registers(), and value holds num_regs quadlets.
+ */
+typedef struct {
+    uint64_t                 offset;
+    uint32_t                 num_regs;
+    uint32_t               * value;
+} dc1394register_io_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -66,6 +76,23 @@ static inline dc1394error_t dc1394_set_register (dc1394camera_t *camera,
 }
 
 
+/**
+ * Reads several ranges of registers. Adjacent and overlapping ranges are merged into block reads, and the
+ * backend keeps several reads in flight where it can (Juju). When the camera refuses the reads, every range is
+ * read again one quadlet at a time.
+ */
+dc1394error_t dc1394_get_registers_vector (dc1394camera_t *camera,
+        dc1394register_io_t *ios, uint32_t num_ios);
+
+/**
+ * Writes several ranges of registers. The writes are not merged, since many cameras only accept quadlet writes to
+ * their control registers, but the backend keeps several of them in flight where it can (Juju). Writes to different
+ * registers may then complete out of order when the camera is busy; a register written twice is written in order.
+ * Use separate calls for writes that depend on each other.
+ */
+dc1394error_t dc1394_set_registers_vector (dc1394camera_t *camera,
+        const dc1394register_io_t *ios, uint32_t num_ios);
+
 /********************************************************************************/
 /* Get/Set Command Registers                                                    */
 /********************************************************************************/
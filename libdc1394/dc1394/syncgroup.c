@@ -0,0 +1,351 @@
+/*
+ * 1394-Based Digital Camera Control Library
+ *
+ * Synchronized capture of several cameras
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#include "control.h"
+#include "capture.h"
+#include "syncgroup.h"
+#include "internal.h"
+
+typedef struct {
+    dc1394camera_t * camera;
+    dc1394video_frame_t ** fifo;        /* dequeued frames not handed out yet, oldest first */
+    uint32_t count;
+    uint32_t size;
+    uint64_t last_timestamp;            /* timestamp of the newest frame dequeued */
+    int seen;
+    int member;
+    int waiting;
+    dc1394sync_stats_t stats;
+} sync_camera_t;
+
+struct __dc1394syncgroup_t {
+    uint32_t num;
+    uint32_t tolerance;
+    dc1394sync_policy_t policy;
+    sync_camera_t cameras[DC1394_SYNCGROUP_MAX_CAMERAS];
+};
+
+static dc1394error_t
+push_frame (sync_camera_t * c, dc1394video_frame_t * frame)
+{
+    if (c->count == c->size) {
+        uint32_t size = c->size ? 2 * c->size : 8;
+        dc1394video_frame_t ** fifo = realloc (c->fifo, size * sizeof *fifo);
+        if (!fifo)
+            return DC1394_MEMORY_ALLOCATION_FAILURE;
+        c->fifo = fifo;
+        c->size = size;
+    }
+    c->fifo[c->count++] = frame;
+    c->last_timestamp = frame->timestamp;
+    c->seen = 1;
+    return DC1394_SUCCESS;
+}
+
+static dc1394video_frame_t *
+pop_frame (sync_camera_t * c)
+{
+    dc1394video_frame_t * frame = c->fifo[0];
+
+    c->count--;
+    memmove (c->fifo, c->fifo + 1, c->count * sizeof *c->fifo);
+    return frame;
+}
+
+/* Moves the frames already captured by a camera to its fifo */
+static dc1394error_t
+drain_camera (sync_camera_t * c)
+{
+    dc1394video_frame_t * frame;
+    dc1394error_t err;
+
+    for (;;) {
+        err = dc1394_capture_dequeue (c->camera, DC1394_CAPTURE_POLICY_POLL,
+                &frame);
+        // frames that failed to be captured go straight back
+        if (err != DC1394_SUCCESS && frame) {
+            dc1394_capture_enqueue (c->camera, frame);
+            continue;
+        }
+        DC1394_ERR_RTN (err, "Could not dequeue a frame of the sync group");
+        if (!frame)
+            return DC1394_SUCCESS;
+        err = push_frame (c, frame);
+        if (err != DC1394_SUCCESS) {
+            dc1394_capture_enqueue (c->camera, frame);
+            return err;
+        }
+    }
+}
+
+static void
+account_set (dc1394syncgroup_t * g, dc1394frameset_t * set)
+{
+    uint32_t i;
+
+    for (i = 0; i < g->num; i++) {
+        sync_camera_t * c = g->cameras + i;
+        int64_t skew;
+
+        if (!set->frames[i])
+            continue;
+        if (!set->complete) {
+            c->stats.frames_unmatched++;
+            continue;
+        }
+        skew = (int64_t) set->frames[i]->timestamp -
+            (int64_t) set->frames[0]->timestamp;
+        if (!c->stats.frames_matched || skew < c->stats.min_skew)
+            c->stats.min_skew = skew;
+        if (!c->stats.frames_matched || skew > c->stats.max_skew)
+            c->stats.max_skew = skew;
+        c->stats.skew += skew;
+        c->stats.frames_matched++;
+    }
+}
+
+/*
+ * Builds a set from the oldest frames of the fifos.  Every camera whose
+ * oldest frame lies within the tolerance of the oldest frame of all is part
+ * of the set.  A camera with an empty fifo may still deliver a matching
+ * frame unless it already delivered a newer one, in which case the cameras
+ * it has to wait for are marked.  Returns 1 when a set was made, 0 when
+ * more frames are needed.
+ */
+static int
+match_frames (dc1394syncgroup_t * g, dc1394frameset_t * set)
+{
+    uint64_t oldest = UINT64_MAX;
+    uint64_t limit;
+    int members = 0, waiting = 0;
+    uint32_t i;
+
+    for (i = 0; i < g->num; i++) {
+        sync_camera_t * c = g->cameras + i;
+        c->member = 0;
+        c->waiting = 0;
+        if (c->count && c->fifo[0]->timestamp < oldest)
+            oldest = c->fifo[0]->timestamp;
+    }
+    if (oldest == UINT64_MAX) {
+        for (i = 0; i < g->num; i++)
+            g->cameras[i].waiting = 1;
+        return 0;
+    }
+
+    limit = oldest + g->tolerance;
+    for (i = 0; i < g->num; i++) {
+        sync_camera_t * c = g->cameras + i;
+        if (c->count) {
+            if (c->fifo[0]->timestamp <= limit) {
+                c->member = 1;
+                members++;
+            }
+        }
+        else if (!c->seen || c->last_timestamp <= limit) {
+            c->waiting = 1;
+            waiting++;
+        }
+    }
+    if (waiting)
+        return 0;
+
+    memset (set, 0, sizeof *set);
+    set->num = g->num;
+    set->timestamp = oldest;
+    set->complete = (members == g->num) ? DC1394_TRUE : DC1394_FALSE;
+    for (i = 0; i < g->num; i++)
+        if (g->cameras[i].member)
+            set->frames[i] = pop_frame (g->cameras + i);
+    account_set (g, set);
+    return 1;
+}
+
+/* Waits for a frame of any of the cameras the group is waiting for */
+static dc1394error_t
+wait_frames (dc1394syncgroup_t * g)
+{
+    dc1394video_frame_t * frame;
+    dc1394error_t err;
+    uint32_t i;
+#ifdef HAVE_POLL_H
+    struct pollfd fds[DC1394_SYNCGROUP_MAX_CAMERAS];
+    int nfds = 0;
+
+    for (i = 0; i < g->num; i++) {
+        int fd;
+        if (!g->cameras[i].waiting)
+            continue;
+        fd = dc1394_capture_get_fileno (g->cameras[i].camera);
+        if (fd < 0) {
+            nfds = 0;
+            break;
+        }
+        fds[nfds].fd = fd;
+        fds[nfds].events = POLLIN;
+        nfds++;
+    }
+    if (nfds) {
+        if (poll (fds, nfds, -1) < 0 && errno != EINTR) {
+            dc1394_log_error ("poll() failed on the sync group: %s",
+                    strerror (errno));
+            return DC1394_FAILURE;
+        }
+        return DC1394_SUCCESS;
+    }
+#endif
+
+    /* Without a descriptor to wait on, block on the first camera missing */
+    for (i = 0; i < g->num; i++)
+        if (g->cameras[i].waiting)
+            break;
+    err = dc1394_capture_dequeue (g->cameras[i].camera,
+            DC1394_CAPTURE_POLICY_WAIT, &frame);
+    if (err != DC1394_SUCCESS && frame) {
+        dc1394_capture_enqueue (g->cameras[i].camera, frame);
+        return DC1394_SUCCESS;
+    }
+    DC1394_ERR_RTN (err, "Could not dequeue a frame of the sync group");
+    if (!frame)
+        return DC1394_SUCCESS;
+    err = push_frame (g->cameras + i, frame);
+    if (err != DC1394_SUCCESS)
+        dc1394_capture_enqueue (g->cameras[i].camera, frame);
+    return err;
+}
+
+dc1394syncgroup_t *
+dc1394_syncgroup_new (dc1394camera_t ** cameras, uint32_t num_cameras,
+        uint32_t tolerance, dc1394sync_policy_t policy)
+{
+    dc1394syncgroup_t * g;
+    uint32_t i;
+
+    if (!cameras || num_cameras == 0 ||
+            num_cameras > DC1394_SYNCGROUP_MAX_CAMERAS) {
+        dc1394_log_error ("A sync group takes 1 to %d cameras",
+                DC1394_SYNCGROUP_MAX_CAMERAS);
+        return NULL;
+    }
+    if (policy < DC1394_SYNC_POLICY_MIN || policy > DC1394_SYNC_POLICY_MAX) {
+        dc1394_log_error ("Invalid sync group policy");
+        return NULL;
+    }
+
+    g = calloc (1, sizeof *g);
+    if (!g)
+        return NULL;
+    g->num = num_cameras;
+    g->tolerance = tolerance;
+    g->policy = policy;
+    for (i = 0; i < num_cameras; i++)
+        g->cameras[i].camera = cameras[i];
+    return g;
+}
+
+void
+dc1394_syncgroup_free (dc1394syncgroup_t * g)
+{
+    uint32_t i;
+
+    if (!g)
+        return;
+    for (i = 0; i < g->num; i++) {
+        sync_camera_t * c = g->cameras + i;
+        while (c->count)
+            dc1394_capture_enqueue (c->camera, pop_frame (c));
+        free (c->fifo);
+    }
+    free (g);
+}
+
+dc1394error_t
+dc1394_syncgroup_dequeue (dc1394syncgroup_t * g, dc1394capture_policy_t policy,
+        dc1394frameset_t * set)
+{
+    dc1394error_t err;
+    uint32_t i;
+
+    if (policy != DC1394_CAPTURE_POLICY_WAIT &&
+            policy != DC1394_CAPTURE_POLICY_POLL)
+        return DC1394_INVALID_CAPTURE_POLICY;
+
+    for (;;) {
+        for (i = 0; i < g->num; i++) {
+            err = drain_camera (g->cameras + i);
+            if (err != DC1394_SUCCESS)
+                return err;
+        }
+
+        if (match_frames (g, set)) {
+            if (set->complete || g->policy == DC1394_SYNC_POLICY_FLAG)
+                return DC1394_SUCCESS;
+            dc1394_syncgroup_enqueue (g, set);
+            continue;
+        }
+
+        if (policy == DC1394_CAPTURE_POLICY_POLL) {
+            memset (set, 0, sizeof *set);
+            return DC1394_SUCCESS;
+        }
+        err = wait_frames (g);
+        if (err != DC1394_SUCCESS)
+            return err;
+    }
+}
+
+dc1394error_t
+dc1394_syncgroup_enqueue (dc1394syncgroup_t * g, dc1394frameset_t * set)
+{
+    dc1394error_t err, ret = DC1394_SUCCESS;
+    uint32_t i;
+
+    for (i = 0; i < set->num && i < g->num; i++) {
+        if (!set->frames[i])
+            continue;
+        err = dc1394_capture_enqueue (g->cameras[i].camera, set->frames[i]);
+        if (err != DC1394_SUCCESS)
+            ret = err;
+        set->frames[i] = NULL;
+    }
+    return ret;
+}
+
+dc1394error_t
+dc1394_syncgroup_get_stats (dc1394syncgroup_t * g, uint32_t camera_index,
+        dc1394sync_stats_t * stats)
+{
+    if (!stats || camera_index >= g->num)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+    *stats = g->cameras[camera_index].stats;
+    return DC1394_SUCCESS;
+}
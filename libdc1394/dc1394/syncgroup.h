@@ -0,0 +1,118 @@
+/*
+ * 1394-Based Digital Camera Control Library
+ *
+ * Synchronized capture of several cameras
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <dc1394/log.h>
+#include <dc1394/video.h>
+#include <dc1394/capture.h>
+
+#ifndef __DC1394_SYNCGROUP_H__
+#define __DC1394_SYNCGROUP_H__
+
+/*! \file dc1394/syncgroup.h
+    \brief Synchronized capture: sets of frames of several cameras matched by timestamp
+
+    A sync group dequeues the frames of several capturing cameras and hands them out as framesets: one frame per camera,
+    with timestamps within a tolerance of each other. Frames are matched as they arrive, oldest first, without copies.
+    A frame that can not be matched any more, because the other cameras already delivered newer frames, is dropped or
+    handed out in an incomplete frameset, depending on the policy of the group.
+
+    The tolerance should stay under half the frame period, so that a frame can only match one frame of each other camera.
+*/
+
+/**
+ * Maximum number of cameras in a sync group
+ */
+#define DC1394_SYNCGROUP_MAX_CAMERAS 16
+
+/**
+ * What to do with frames that have no match in the other cameras
+ */
+typedef enum {
+    DC1394_SYNC_POLICY_DROP = 0,   /* give them back to the ring buffer */
+    DC1394_SYNC_POLICY_FLAG        /* hand them out in an incomplete frameset */
+} dc1394sync_policy_t;
+#define DC1394_SYNC_POLICY_MIN    DC1394_SYNC_POLICY_DROP
+#define DC1394_SYNC_POLICY_MAX    DC1394_SYNC_POLICY_FLAG
+#define DC1394_SYNC_POLICY_NUM   (DC1394_SYNC_POLICY_MAX - DC1394_SYNC_POLICY_MIN + 1)
+
+/**
+ * Opaque sync group.
+ */
+typedef struct __dc1394syncgroup_t dc1394syncgroup_t;
+
+/**
+ * A set of frames, in the order of the cameras of the group.
+ */
+typedef struct {
+    uint32_t                 num;                  /* number of cameras in the group */
+    dc1394video_frame_t    * frames[DC1394_SYNCGROUP_MAX_CAMERAS]; /* the frames, NULL for a camera without a match */
+    uint64_t                 timestamp;            /* the timestamp of the oldest frame of the set */
+    dc1394bool_t             complete;             /* DC1394_TRUE if every camera has a frame in the set */
+} dc1394frameset_t;
+
+/**
+ * Statistics of a camera of a sync group. The skew is the timestamp of the frame of the camera minus the timestamp of
+ * the frame of the first camera, in complete framesets. Times are in microseconds.
+ */
+typedef struct {
+    uint64_t                 frames_matched;       /* frames handed out in complete framesets */
+    uint64_t                 frames_unmatched;     /* frames dropped or handed out in incomplete framesets */
+    int64_t                  skew;                 /* sum of the skews; divide by frames_matched for the mean */
+    int64_t                  min_skew;             /* smallest skew */
+    int64_t                  max_skew;             /* largest skew */
+} dc1394sync_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates a sync group for capturing cameras. The timestamps of the frames of a set differ by at most tolerance
+ * microseconds.
+ */
+dc1394syncgroup_t * dc1394_syncgroup_new(dc1394camera_t **cameras, uint32_t num_cameras, uint32_t tolerance,
+                                         dc1394sync_policy_t policy);
+
+/**
+ * Frees a sync group, giving back the frames it still holds. The capture of the cameras is not stopped.
+ */
+void dc1394_syncgroup_free(dc1394syncgroup_t *group);
+
+/**
+ * Gets the next frameset. With DC1394_CAPTURE_POLICY_WAIT the call blocks until a set can be handed out; with
+ * DC1394_CAPTURE_POLICY_POLL it returns a set with no frames (num equal to zero) if none is ready yet.
+ */
+dc1394error_t dc1394_syncgroup_dequeue(dc1394syncgroup_t *group, dc1394capture_policy_t policy, dc1394frameset_t *set);
+
+/**
+ * Gives the frames of a set back to the ring buffers of their cameras.
+ */
+dc1394error_t dc1394_syncgroup_enqueue(dc1394syncgroup_t *group, dc1394frameset_t *set);
+
+/**
+ * Gets the statistics of a camera of the group, given by its position in the group.
+ */
+dc1394error_t dc1394_syncgroup_get_stats(dc1394syncgroup_t *group, uint32_t camera_index, dc1394sync_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -20,94 +20,399 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#include "config.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
 
 #include "usb/usb.h"
+#include "usb/capture.h"
 
-/* Callback whenever a bulk transfer finishes. */
+static uint64_t
+get_monotonic_usec (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Works out when the camera started sending a frame, in unix time like the
+ * timestamps of the other platforms.  The completion times are taken on the
+ * monotonic clock, so that a wall clock step during the transfer does not
+ * distort the correction.  The rate at which the chunks after the first one
+ * arrived tells how long the first chunk took; with a single chunk per frame
+ * there is nothing to measure and the bulk rate of the bus is assumed. */
+static uint64_t
+frame_start_time (struct usb_frame * f, uint64_t done, uint32_t done_bytes)
+{
+    uint64_t start = f->first_time;
+    uint64_t rest = done_bytes - f->first_bytes;
+
+    if (rest > 0 && done > f->first_time)
+        start -= (done - f->first_time) * f->first_bytes / rest;
+    else if (rest == 0)
+        start -= (uint64_t) f->first_bytes * 1000 / f->pcam->bus_bytes_per_msec;
+
+    return capture_get_time_usec () - (get_monotonic_usec () - start);
+}
+
+/* Cancels the chunks of a frame that follow a short or failed one, so that
+ * they do not take the start of the next frame from the endpoint.  They are
+ * called back as cancelled and complete the frame. */
 static void
-callback (struct libusb_transfer * transfer)
+cancel_frame_rest (platform_camera_t * craw, struct usb_frame * f,
+        struct libusb_transfer * transfer)
 {
-    struct usb_frame * f = transfer->user_data;
-    platform_camera_t * craw = f->pcam;
+    int i = 0;
 
-    if (transfer->status == LIBUSB_TRANSFER_CANCELLED) {
-        dc1394_log_warning ("usb: Bulk transfer %d cancelled", f->frame.id);
+    if (__sync_fetch_and_or (&f->chunk_flags, CHUNK_CANCELLED)
+            & CHUNK_CANCELLED)
         return;
-    }
+    while (f->transfers[i] != transfer)
+        i++;
+    for (i++; i < craw->frame_chunks; i++)
+        libusb_cancel_transfer (f->transfers[i]);
+}
 
-    dc1394_log_debug ("usb: Bulk transfer %d complete, %d of %d bytes",
-            f->frame.id, transfer->actual_length, transfer->length);
-    int status = BUFFER_FILLED;
-    if (transfer->actual_length < transfer->length)
-        status = BUFFER_CORRUPT;
+/* Accounts for a bulk transfer that finished.  A frame is complete when the
+ * last of its chunks has been called back. */
+static void
+transfer_done (platform_camera_t * craw, struct usb_frame * f,
+        struct libusb_transfer * transfer)
+{
+    if (transfer->status == LIBUSB_TRANSFER_CANCELLED) {
+        dc1394_log_debug ("usb: Bulk transfer %d cancelled", f->frame.id);
+        // cancelled by capture stop: the frame is dropped
+        if (!(f->chunk_flags & CHUNK_CANCELLED))
+            return;
+    }
+    else
+        dc1394_log_debug ("usb: Bulk transfer %d complete, %d of %d bytes",
+                f->frame.id, transfer->actual_length, transfer->length);
+
+    uint64_t now = get_monotonic_usec ();
+    if (f->chunks_left == craw->frame_chunks) {
+        f->first_time = now;
+        f->first_bytes = transfer->actual_length;
+    }
+    f->received_bytes += transfer->actual_length;
 
-    if (transfer->status != LIBUSB_TRANSFER_COMPLETED) {
+    if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
+        if (transfer->actual_length < transfer->length) {
+            __sync_fetch_and_or (&f->chunk_flags, CHUNK_SHORT);
+            cancel_frame_rest (craw, f, transfer);
+        }
+    }
+    else if (transfer->status != LIBUSB_TRANSFER_CANCELLED) {
         dc1394_log_error ("usb: Bulk transfer %d failed with code %d",
                 f->frame.id, transfer->status);
+        __sync_fetch_and_or (&f->chunk_flags, CHUNK_FAILED);
+        cancel_frame_rest (craw, f, transfer);
+    }
+
+    if (__sync_sub_and_fetch (&f->chunks_left, 1) > 0)
+        return;
+
+    f->frame_time = frame_start_time (f, now, f->received_bytes);
+
+    int status = BUFFER_FILLED;
+    if (f->chunk_flags & CHUNK_FAILED)
         status = BUFFER_ERROR;
+    else if (f->chunk_flags & CHUNK_SHORT)
+        status = BUFFER_CORRUPT;
+
+    __atomic_store_n (&f->status, status, __ATOMIC_RELEASE);
+    __sync_add_and_fetch (&craw->frames_ready, 1);
+
+    // a full pipe already wakes the consumer up
+#ifdef HAVE_SYS_EVENTFD_H
+    uint64_t one = 1;
+    if (write (craw->notify_fd[1], &one, sizeof one) != sizeof one
+            && errno != EAGAIN)
+#else
+    if (write (craw->notify_fd[1], "+", 1) != 1 && errno != EAGAIN)
+#endif
+        dc1394_log_error ("usb: Failed to signal a completed transfer");
+}
+
+/* Bulk payload the bus carries at most in a millisecond: 19 packets of 64
+ * bytes per frame at full speed, 13 packets of 512 bytes per microframe at
+ * high speed, and roughly 400 MB/s at super speed. */
+static uint32_t
+bulk_bytes_per_msec (platform_camera_t * craw)
+{
+#if defined(LIBUSB_API_VERSION)
+    switch (libusb_get_device_speed (libusb_get_device (craw->handle))) {
+    case LIBUSB_SPEED_FULL:
+        return 19 * 64;
+    case LIBUSB_SPEED_SUPER:
+        return 400000;
+    default:
+        break;
     }
+#endif
+    return 8 * 13 * 512;
+}
+
+/* Callback whenever a bulk transfer finishes. */
+static void
+callback (struct libusb_transfer * transfer)
+{
+    struct usb_frame * f = transfer->user_data;
+    platform_camera_t * craw = f->pcam;
+
+    transfer_done (craw, f, transfer);
 
-    pthread_mutex_lock (&craw->mutex);
-    f->status = status;
-    craw->frames_ready++;
-    pthread_mutex_unlock (&craw->mutex);
+    // last: capture stop frees the frames as soon as it sees idle
+    if (__sync_sub_and_fetch (&craw->in_flight, 1) == 0)
+        __atomic_store_n (&craw->idle, 1, __ATOMIC_RELEASE);
+}
+
+/* Returns the status of a frame as last stored by the event thread. */
+static inline usb_frame_status
+frame_status (struct usb_frame * f)
+{
+    return __atomic_load_n (&f->status, __ATOMIC_ACQUIRE);
+}
+
+static dc1394error_t
+open_notify_fd (platform_camera_t * craw)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    int fd = eventfd (0, EFD_NONBLOCK);
+    if (fd < 0)
+        return DC1394_FAILURE;
+    craw->notify_fd[0] = craw->notify_fd[1] = fd;
+#else
+    if (pipe (craw->notify_fd) < 0)
+        return DC1394_FAILURE;
+    fcntl (craw->notify_fd[0], F_SETFL, O_NONBLOCK);
+    fcntl (craw->notify_fd[1], F_SETFL, O_NONBLOCK);
+#endif
+    return DC1394_SUCCESS;
+}
+
+/* Consumes all the completions signalled so far, after waiting for one if
+ * wait is set: a single read of the eventfd, or reads of the pipe until it is
+ * empty.  The status of the frames tells which ones are filled, so the count
+ * itself is not needed. */
+static dc1394error_t
+drain_notify_fd (platform_camera_t * craw, int wait)
+{
+    struct pollfd fds[1];
+#ifdef HAVE_SYS_EVENTFD_H
+    uint64_t count;
+#else
+    char count[64];
+#endif
 
-    if (write (craw->notify_pipe[1], "+", 1)!=1) {
-        dc1394_log_error ("usb: Failed to write to notify pipe");
-        // we may need to set the status to BUFFER_ERROR here
+    if (wait) {
+        fds[0].fd = craw->notify_fd[0];
+        fds[0].events = POLLIN;
+        while (poll (fds, 1, -1) < 0) {
+            if (errno != EINTR) {
+                dc1394_log_error ("usb: Failed to wait for a transfer");
+                return DC1394_FAILURE;
+            }
+        }
+    }
+
+#ifdef HAVE_SYS_EVENTFD_H
+    if (read (craw->notify_fd[0], &count, sizeof count) < 0
+            && errno != EAGAIN) {
+#else
+    ssize_t len;
+    while ((len = read (craw->notify_fd[0], count, sizeof count)) > 0
+            || (len < 0 && errno == EINTR))
+        ;
+    if (len < 0 && errno != EAGAIN) {
+#endif
+        dc1394_log_error ("usb: Failed to read completed transfers");
+        return DC1394_FAILURE;
     }
+    return DC1394_SUCCESS;
 }
 
+#if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+#define HAVE_INTERRUPT_EVENT_HANDLER 1
+#endif
+
+/* Handles the events of the libusb context of the platform for all the
+ * capturing cameras, until the last of them stops. */
 static void *
-capture_thread (void * arg)
+event_thread (void * arg)
 {
-    platform_camera_t * craw = arg;
+    platform_t * p = arg;
 
-    dc1394_log_debug ("usb: Helper thread starting");
+    dc1394_log_debug ("usb: Event thread starting");
 
-    while (1) {
+    while (!p->kill_thread) {
+#ifdef HAVE_INTERRUPT_EVENT_HANDLER
+        libusb_handle_events_completed (p->context, &p->kill_thread);
+#else
         struct timeval tv = {
             .tv_sec = 0,
             .tv_usec = 100000,
         };
-        libusb_handle_events_timeout(craw->thread_context, &tv);
-        pthread_mutex_lock (&craw->mutex);
-        if (craw->kill_thread)
-            break;
-        pthread_mutex_unlock (&craw->mutex);
-    }
-    pthread_mutex_unlock (&craw->mutex);
-    dc1394_log_debug ("usb: Helper thread ending");
+        libusb_handle_events_timeout_completed (p->context, &tv,
+                &p->kill_thread);
+#endif
+    }
+
+    dc1394_log_debug ("usb: Event thread ending");
     return NULL;
 }
 
 static dc1394error_t
-init_frame(platform_camera_t *craw, int index, dc1394video_frame_t *proto)
+use_event_thread (platform_t * p)
+{
+    dc1394error_t err = DC1394_SUCCESS;
+
+    pthread_mutex_lock (&p->lock);
+    if (p->thread_users == 0) {
+        p->kill_thread = 0;
+        if (pthread_create (&p->thread, NULL, event_thread, p) != 0) {
+            dc1394_log_error ("usb: Failed to launch event thread");
+            err = DC1394_FAILURE;
+        }
+    }
+    if (err == DC1394_SUCCESS)
+        p->thread_users++;
+    pthread_mutex_unlock (&p->lock);
+
+    return err;
+}
+
+static void
+release_event_thread (platform_t * p)
+{
+    pthread_mutex_lock (&p->lock);
+    if (--p->thread_users == 0) {
+        p->kill_thread = 1;
+#ifdef HAVE_INTERRUPT_EVENT_HANDLER
+        libusb_interrupt_event_handler (p->context);
+#endif
+        pthread_join (p->thread, NULL);
+        dc1394_log_debug ("usb: Joined with event thread");
+    }
+    pthread_mutex_unlock (&p->lock);
+}
+
+static dc1394error_t
+init_frame(platform_camera_t *craw, int index, dc1394video_frame_t *proto,
+        unsigned char * image)
 {
     struct usb_frame *f = craw->frames + index;
+    int i;
 
     memcpy (&f->frame, proto, sizeof f->frame);
-    f->frame.image = craw->buffer + index * proto->total_bytes;
+    f->frame.image = image;
     f->frame.id = index;
-    f->transfer = libusb_alloc_transfer (0);
     f->pcam = craw;
     f->status = BUFFER_EMPTY;
+    f->leased = 0;
+
+    f->transfers = calloc (craw->frame_chunks, sizeof *f->transfers);
+    if (f->transfers == NULL)
+        return DC1394_MEMORY_ALLOCATION_FAILURE;
+    for (i = 0; i < craw->frame_chunks; i++) {
+        f->transfers[i] = libusb_alloc_transfer (0);
+        if (f->transfers[i] == NULL)
+            return DC1394_MEMORY_ALLOCATION_FAILURE;
+    }
     return DC1394_SUCCESS;
 }
 
-dc1394error_t
-dc1394_usb_capture_setup(platform_camera_t *craw, uint32_t num_dma_buffers,
-        uint32_t flags)
+static void
+release_frame(platform_camera_t *craw, int index)
+{
+    struct usb_frame *f = craw->frames + index;
+    int i;
+
+    if (f->transfers == NULL)
+        return;
+    for (i = 0; i < craw->frame_chunks; i++)
+        libusb_free_transfer (f->transfers[i]);
+    free (f->transfers);
+    f->transfers = NULL;
+    if (f->own_image)
+        free (f->frame.image);
+    f->own_image = 0;
+}
+
+/* Splits the frames in chunks of whole bulk packets, one transfer each. */
+static void
+fill_frame_transfers (platform_camera_t * craw, struct usb_frame * f,
+        uint32_t chunk_size)
+{
+    uint64_t offset = 0;
+    int i;
+
+    for (i = 0; i < craw->frame_chunks; i++) {
+        uint64_t length = f->frame.total_bytes - offset;
+        if (length > chunk_size)
+            length = chunk_size;
+        libusb_fill_bulk_transfer (f->transfers[i], craw->handle,
+                0x81, f->frame.image + offset, length, callback, f, 0);
+        offset += length;
+    }
+}
+
+/* Submits the transfers of a frame and appends it to the queue of frames
+ * that will complete in that order. */
+static dc1394error_t
+submit_frame (platform_camera_t * craw, struct usb_frame * f)
+{
+    int i;
+
+    __atomic_store_n (&f->status, BUFFER_EMPTY, __ATOMIC_RELAXED);
+    f->chunks_left = craw->frame_chunks;
+    f->chunk_flags = 0;
+    f->received_bytes = 0;
+    f->submit_time = capture_get_time_usec ();
+
+    // queued first so that capture stop cancels a partial submission
+    craw->queue[(craw->queue_head + craw->queue_count) % craw->num_frames] =
+        f->frame.id;
+    craw->queue_count++;
+
+    __atomic_store_n (&craw->idle, 0, __ATOMIC_RELEASE);
+    for (i = 0; i < craw->frame_chunks; i++) {
+        __sync_add_and_fetch (&craw->in_flight, 1);
+        if (libusb_submit_transfer (f->transfers[i]) != LIBUSB_SUCCESS) {
+            if (__sync_sub_and_fetch (&craw->in_flight, 1) == 0)
+                __atomic_store_n (&craw->idle, 1, __ATOMIC_RELEASE);
+            craw->queue_broken = 1;
+            return DC1394_FAILURE;
+        }
+    }
+
+    return DC1394_SUCCESS;
+}
+
+/* Sets up the capture into num_buffers library buffers plus the reserve,
+ * or into the num_buffers buffers of buffer_size bytes given by the user,
+ * the last ones of which form the reserve. */
+static dc1394error_t
+usb_capture_setup(platform_camera_t *craw, uint32_t num_buffers,
+        uint32_t flags, unsigned char ** buffers, uint64_t buffer_size)
 {
     dc1394video_frame_t proto;
     int i;
     dc1394camera_t * camera = craw->camera;
+    uint32_t reserve = DC1394_CAMERA_PRIV (camera)->capture_reserve;
+    uint32_t num_dma_buffers = num_buffers;
 
     // if capture is already set, abort
     if (craw->capture_is_set > 0)
@@ -127,95 +432,103 @@ dc1394_usb_capture_setup(platform_camera_t *craw, uint32_t num_dma_buffers,
         return DC1394_FAILURE;
     }
 
-    if (pipe (craw->notify_pipe) < 0) {
+    if (open_notify_fd (craw) != DC1394_SUCCESS) {
         dc1394_usb_capture_stop (craw);
         return DC1394_FAILURE;
     }
 
+    craw->in_flight = 0;
+    craw->idle = 1;
+    craw->bus_bytes_per_msec = bulk_bytes_per_msec (craw);
+
     dc1394_log_debug ("usb: Frame size is %"PRId64, proto.total_bytes);
 
-    craw->num_frames = num_dma_buffers;
-    craw->current = -1;
+    int max_packet = libusb_get_max_packet_size (libusb_get_device (craw->handle),
+            0x81);
+    if (max_packet <= 0)
+        max_packet = 512;
+    uint32_t chunk_size = proto.total_bytes;
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+    if (craw->num_chunks > 1) {
+        chunk_size = (proto.total_bytes + craw->num_chunks - 1)
+            / craw->num_chunks;
+        chunk_size = (chunk_size + max_packet - 1) / max_packet * max_packet;
+    }
+    craw->frame_chunks = (proto.total_bytes + chunk_size - 1) / chunk_size;
+    craw->chunk_size = chunk_size;
+    dc1394_log_debug ("usb: Using %d transfers of %d bytes per frame",
+            craw->frame_chunks, chunk_size);
+
+    if (buffers) {
+        if (buffer_size < proto.total_bytes || reserve >= num_buffers) {
+            dc1394_log_error ("usb: User buffers are too small or too few");
+            dc1394_usb_capture_stop (craw);
+            return DC1394_INVALID_ARGUMENT_VALUE;
+        }
+        num_dma_buffers = num_buffers - reserve;
+        reserve = 0;
+    }
+
+    craw->num_frames = num_dma_buffers + reserve;
+    craw->num_dma_buffers = num_dma_buffers;
+    craw->max_frames = craw->num_frames;
+    // leave room for the ring to grow into
+    if (!buffers && cpriv->auto_buffers_target > 0 &&
+            cpriv->auto_buffers_max > num_dma_buffers)
+        craw->max_frames = cpriv->auto_buffers_max + reserve;
+    craw->queue_head = craw->queue_count = 0;
+    craw->spare_count = 0;
     craw->frames_ready = 0;
     craw->queue_broken = 0;
-    craw->buffer_size = proto.total_bytes * num_dma_buffers;
-    craw->buffer = malloc (craw->buffer_size);
-    if (craw->buffer == NULL) {
-        dc1394_usb_capture_stop (craw);
-        return DC1394_MEMORY_ALLOCATION_FAILURE;
+    if (!buffers) {
+        craw->buffer_size = proto.total_bytes * craw->num_frames;
+        craw->buffer = malloc (craw->buffer_size);
+        if (craw->buffer == NULL) {
+            dc1394_usb_capture_stop (craw);
+            return DC1394_MEMORY_ALLOCATION_FAILURE;
+        }
     }
 
-    craw->frames = calloc (num_dma_buffers, sizeof *craw->frames);
-    if (craw->frames == NULL) {
+    craw->frames = calloc (craw->max_frames, sizeof *craw->frames);
+    craw->queue = malloc (craw->max_frames * sizeof *craw->queue);
+    craw->spare = malloc (craw->max_frames * sizeof *craw->spare);
+    if (craw->frames == NULL || craw->queue == NULL || craw->spare == NULL) {
         dc1394_usb_capture_stop (craw);
         return DC1394_MEMORY_ALLOCATION_FAILURE;
     }
 
-    for (i = 0; i < num_dma_buffers; i++)
-        init_frame(craw, i, &proto);
-
-    if (libusb_init(&craw->thread_context) != 0) {
-        dc1394_log_error ("usb: Failed to create thread USB context");
-        dc1394_usb_capture_stop (craw);
-        return DC1394_FAILURE;
-    }
-
-    uint8_t bus = libusb_get_bus_number (libusb_get_device (craw->handle));
-    uint8_t addr = libusb_get_device_address (libusb_get_device (craw->handle));
-
-    libusb_device **list, *dev;
-    libusb_get_device_list (craw->thread_context, &list);
-    for (i = 0, dev = list[0]; dev; dev = list[++i]) {
-        if (libusb_get_bus_number (dev) == bus &&
-                libusb_get_device_address (dev) == addr)
-            break;
-    }
-    if (!dev) {
-        libusb_free_device_list (list, 1);
-        dc1394_log_error ("usb: capture thread failed to find device");
-        dc1394_usb_capture_stop (craw);
-        return DC1394_FAILURE;
+    for (i = 0; i < craw->num_frames; i++) {
+        if (init_frame(craw, i, &proto, buffers ? buffers[i] :
+                    craw->buffer + i * proto.total_bytes) != DC1394_SUCCESS) {
+            dc1394_usb_capture_stop (craw);
+            return DC1394_MEMORY_ALLOCATION_FAILURE;
+        }
     }
 
-    if (libusb_open (dev, &craw->thread_handle) < 0) {
-        libusb_free_device_list (list, 1);
-        dc1394_log_error ("usb: capture thread failed to open device");
+    if (libusb_claim_interface (craw->handle, 0) < 0) {
+        dc1394_log_error ("usb: Failed to claim interface for capture");
         dc1394_usb_capture_stop (craw);
         return DC1394_FAILURE;
     }
-    libusb_free_device_list (list, 1);
+    craw->interface_claimed = 1;
 
-    if (libusb_claim_interface (craw->thread_handle, 0) < 0) {
-        dc1394_log_error ("usb: capture thread failed to claim interface");
+    if (use_event_thread (craw->platform) != DC1394_SUCCESS) {
         dc1394_usb_capture_stop (craw);
         return DC1394_FAILURE;
     }
+    craw->thread_used = 1;
 
-    for (i = 0; i < craw->num_frames; i++) {
-        struct usb_frame *f = craw->frames + i;
-        libusb_fill_bulk_transfer (f->transfer, craw->thread_handle,
-                0x81, f->frame.image, f->frame.total_bytes,
-                callback, f, 0);
-    }
-    for (i = 0; i < craw->num_frames; i++) {
-        if (libusb_submit_transfer (craw->frames[i].transfer) < 0) {
+    for (i = 0; i < craw->num_frames; i++)
+        fill_frame_transfers (craw, craw->frames + i, craw->chunk_size);
+    for (i = 0; i < num_dma_buffers; i++) {
+        if (submit_frame (craw, craw->frames + i) != DC1394_SUCCESS) {
             dc1394_log_error ("usb: Failed to submit initial transfer %d", i);
             dc1394_usb_capture_stop (craw);
             return DC1394_FAILURE;
         }
     }
-
-    if (pthread_mutex_init (&craw->mutex, NULL) < 0) {
-        dc1394_usb_capture_stop (craw);
-        return DC1394_FAILURE;
-    }
-    craw->mutex_created = 1;
-    if (pthread_create (&craw->thread, NULL, capture_thread, craw) < 0) {
-        dc1394_log_error ("usb: Failed to launch helper thread");
-        dc1394_usb_capture_stop (craw);
-        return DC1394_FAILURE;
-    }
-    craw->thread_created = 1;
+    for (i = craw->num_frames - 1; i >= (int) num_dma_buffers; i--)
+        craw->spare[craw->spare_count++] = i;
 
     // if auto iso is requested, start ISO
     if (flags & DC1394_CAPTURE_FLAGS_AUTO_ISO) {
@@ -226,6 +539,106 @@ dc1394_usb_capture_setup(platform_camera_t *craw, uint32_t num_dma_buffers,
     return DC1394_SUCCESS;
 }
 
+dc1394error_t
+dc1394_usb_capture_setup(platform_camera_t *craw, uint32_t num_dma_buffers,
+        uint32_t flags)
+{
+    return usb_capture_setup (craw, num_dma_buffers, flags, NULL, 0);
+}
+
+dc1394error_t
+dc1394_usb_capture_setup_user_buffers (dc1394camera_t * camera,
+        unsigned char ** buffers, uint32_t num_buffers, uint64_t buffer_size,
+        uint32_t flags)
+{
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+
+    if (strcmp (cpriv->platform->name, "usb") != 0)
+        return DC1394_FUNCTION_NOT_SUPPORTED;
+    if (!buffers || num_buffers == 0)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+
+    capture_reset_stats (camera);
+    cpriv->capture_buffers = num_buffers;
+    cpriv->capture_restartable = 0;
+    return usb_capture_setup (cpriv->pcam, num_buffers, flags, buffers,
+            buffer_size);
+}
+
+/* Adds frames to the ring without stopping the capture.  The new frames get
+ * their own image buffer and are queued behind the frames in flight. */
+dc1394error_t
+dc1394_usb_capture_grow (platform_camera_t * craw, uint32_t num_dma_buffers)
+{
+    dc1394video_frame_t proto;
+    int * queue;
+    unsigned int i, num_frames;
+
+    if (craw->capture_is_set == 0)
+        return DC1394_CAPTURE_IS_NOT_SET;
+    if (craw->queue_broken)
+        return DC1394_FAILURE;
+    if (num_dma_buffers <= craw->num_dma_buffers)
+        return DC1394_SUCCESS;
+
+    num_frames = craw->num_frames + num_dma_buffers - craw->num_dma_buffers;
+    if (num_frames > craw->max_frames) {
+        dc1394_log_error ("usb: No room to grow the ring to %d buffers",
+                num_dma_buffers);
+        return DC1394_INVALID_ARGUMENT_VALUE;
+    }
+
+    /* The queue is indexed modulo the number of frames, unroll it first */
+    queue = malloc (craw->queue_count * sizeof *queue);
+    if (queue == NULL)
+        return DC1394_MEMORY_ALLOCATION_FAILURE;
+    for (i = 0; i < craw->queue_count; i++)
+        queue[i] = craw->queue[(craw->queue_head + i) % craw->num_frames];
+    memcpy (craw->queue, queue, craw->queue_count * sizeof *queue);
+    craw->queue_head = 0;
+    free (queue);
+
+    memcpy (&proto, &craw->frames[0].frame, sizeof proto);
+    for (i = craw->num_frames; i < num_frames; i++) {
+        struct usb_frame * f = craw->frames + i;
+        unsigned char * image = malloc (proto.total_bytes);
+
+        if (image == NULL)
+            return DC1394_MEMORY_ALLOCATION_FAILURE;
+        if (init_frame (craw, i, &proto, image) != DC1394_SUCCESS) {
+            free (image);
+            release_frame (craw, i);
+            return DC1394_MEMORY_ALLOCATION_FAILURE;
+        }
+        f->own_image = 1;
+        fill_frame_transfers (craw, f, craw->chunk_size);
+
+        craw->num_frames++;
+        craw->num_dma_buffers++;
+        if (submit_frame (craw, f) != DC1394_SUCCESS) {
+            dc1394_log_error ("usb: Failed to submit transfer %d", i);
+            return DC1394_FAILURE;
+        }
+    }
+
+    dc1394_log_debug ("usb: Ring grown to %d buffers", craw->num_dma_buffers);
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_usb_capture_set_chunks (dc1394camera_t * camera, uint32_t num_chunks)
+{
+    dc1394camera_priv_t * cpriv = DC1394_CAMERA_PRIV (camera);
+
+    if (strcmp (cpriv->platform->name, "usb") != 0)
+        return DC1394_FUNCTION_NOT_SUPPORTED;
+    if (cpriv->pcam->capture_is_set)
+        return DC1394_CAPTURE_IS_RUNNING;
+
+    cpriv->pcam->num_chunks = num_chunks;
+    return DC1394_SUCCESS;
+}
+
 dc1394error_t
 dc1394_usb_capture_stop(platform_camera_t *craw)
 {
@@ -243,68 +656,88 @@ dc1394_usb_capture_stop(platform_camera_t *craw)
         craw->iso_auto_started = 0;
     }
 
-    if (craw->thread_created) {
-#if 0
-        for (i = 0; i < craw->num_frames; i++) {
-            libusb_cancel_transfer (craw->frames[i].transfer);
+    if (craw->thread_used) {
+        /* Cancel the pending transfers and let the event thread call them
+         * back before they are freed */
+        for (i = 0; i < craw->queue_count; i++) {
+            int index = craw->queue[(craw->queue_head + i) % craw->num_frames];
+            int j;
+            for (j = 0; j < craw->frame_chunks; j++)
+                libusb_cancel_transfer (craw->frames[index].transfers[j]);
         }
-#endif
-        pthread_mutex_lock (&craw->mutex);
-        craw->kill_thread = 1;
-        pthread_mutex_unlock (&craw->mutex);
-        pthread_join (craw->thread, NULL);
-        dc1394_log_debug ("usb: Joined with helper thread");
-        craw->kill_thread = 0;
-        craw->thread_created = 0;
-    }
-
-    if (craw->mutex_created) {
-        pthread_mutex_destroy (&craw->mutex);
-        craw->mutex_created = 0;
+        libusb_handle_events_completed (craw->platform->context, &craw->idle);
+        release_event_thread (craw->platform);
+        craw->thread_used = 0;
     }
 
-    if (craw->thread_handle) {
-        libusb_release_interface (craw->thread_handle, 0);
-        libusb_close (craw->thread_handle);
-        craw->thread_handle = NULL;
-    }
-
-    if (craw->thread_context) {
-        libusb_exit (craw->thread_context);
-        craw->thread_context = NULL;
+    if (craw->interface_claimed) {
+        libusb_release_interface (craw->handle, 0);
+        craw->interface_claimed = 0;
     }
 
     if (craw->frames) {
-        for (i = 0; i < craw->num_frames; i++) {
-            libusb_free_transfer (craw->frames[i].transfer);
-        }
+        for (i = 0; i < craw->num_frames; i++)
+            release_frame (craw, i);
         free (craw->frames);
         craw->frames = NULL;
     }
+    free (craw->queue);
+    free (craw->spare);
+    craw->queue = craw->spare = NULL;
 
     free (craw->buffer);
     craw->buffer = NULL;
 
-    if (craw->notify_pipe[0] != 0 || craw->notify_pipe[1] != 0) {
-        close (craw->notify_pipe[0]);
-        close (craw->notify_pipe[1]);
-    }
-    craw->notify_pipe[0] = 0;
-    craw->notify_pipe[1] = 0;
+    if (craw->notify_fd[0] != 0)
+        close (craw->notify_fd[0]);
+    if (craw->notify_fd[1] != 0 && craw->notify_fd[1] != craw->notify_fd[0])
+        close (craw->notify_fd[1]);
+    craw->notify_fd[0] = 0;
+    craw->notify_fd[1] = 0;
 
     craw->capture_is_set = 0;
 
     return DC1394_SUCCESS;
 }
 
-#define NEXT_BUFFER(c,i) (((i) == -1) ? 0 : ((i)+1)%(c)->num_frames)
+/* Number of filled frames at the head of the queue. */
+static int
+frames_filled (platform_camera_t * craw)
+{
+    int n = 0;
+
+    while (n < craw->queue_count && frame_status (craw->frames +
+                craw->queue[(craw->queue_head + n) % craw->num_frames])
+            != BUFFER_EMPTY)
+        n++;
+    return n;
+}
+
+/* Takes the frame at the head of the queue, which must be filled. */
+static struct usb_frame *
+take_next_frame (platform_camera_t * craw)
+{
+    struct usb_frame * f = craw->frames + craw->queue[craw->queue_head];
+
+    f->frame.frames_behind = __sync_sub_and_fetch (&craw->frames_ready, 1);
+
+    craw->queue_head = (craw->queue_head + 1) % craw->num_frames;
+    craw->queue_count--;
+
+    f->frame.timestamp = f->frame_time;
+    capture_account_frame (craw->camera, &f->frame, f->frame_time,
+            f->submit_time);
+
+    return f;
+}
 
 dc1394error_t
 dc1394_usb_capture_dequeue (platform_camera_t * craw,
         dc1394capture_policy_t policy, dc1394video_frame_t **frame_return)
 {
-    int next = NEXT_BUFFER (craw, craw->current);
-    struct usb_frame * f = craw->frames + next;
+    struct usb_frame * f;
+    uint32_t skipped = 0;
+    int filled;
 
     if ((policy < DC1394_CAPTURE_POLICY_MIN)
             || (policy > DC1394_CAPTURE_POLICY_MAX))
@@ -313,39 +746,45 @@ dc1394_usb_capture_dequeue (platform_camera_t * craw,
     /* default: return NULL in case of failures or lack of frames */
     *frame_return = NULL;
 
-    if (policy == DC1394_CAPTURE_POLICY_POLL) {
-        int status;
-        pthread_mutex_lock (&craw->mutex);
-        status = f->status;
-        pthread_mutex_unlock (&craw->mutex);
-        if (status == BUFFER_EMPTY)
-            return DC1394_SUCCESS;
-    }
-
     if (craw->queue_broken)
         return DC1394_FAILURE;
 
-    char ch;
-    if (read (craw->notify_pipe[0], &ch, 1)!=1) {
-        dc1394_log_error ("usb: Failed to read from notify pipe");
-        return DC1394_FAILURE;
+    /* The notification descriptor is only read once no filled frame is
+     * left, so that a burst of completions costs a single read. */
+    filled = frames_filled (craw);
+    if (filled == 0) {
+        if (drain_notify_fd (craw, 0) != DC1394_SUCCESS)
+            return DC1394_FAILURE;
+        filled = frames_filled (craw);
+    }
+    if (filled == 0) {
+        if (policy == DC1394_CAPTURE_POLICY_POLL || craw->queue_count == 0)
+            return DC1394_SUCCESS;
+        while (filled == 0) {
+            if (drain_notify_fd (craw, 1) != DC1394_SUCCESS)
+                return DC1394_FAILURE;
+            filled = frames_filled (craw);
+        }
     }
 
-    pthread_mutex_lock (&craw->mutex);
-    if (f->status == BUFFER_EMPTY) {
-        dc1394_log_error ("usb: Expected filled buffer");
-        pthread_mutex_unlock (&craw->mutex);
-        return DC1394_FAILURE;
+    /* give all but the newest of the filled frames back to the camera */
+    if (policy == DC1394_CAPTURE_POLICY_LATEST) {
+        for (skipped = 0; skipped < filled - 1; skipped++) {
+            f = take_next_frame (craw);
+            if (dc1394_usb_capture_enqueue (craw, &f->frame)
+                    != DC1394_SUCCESS)
+                return DC1394_FAILURE;
+        }
     }
-    craw->frames_ready--;
-    f->frame.frames_behind = craw->frames_ready;
-    pthread_mutex_unlock (&craw->mutex);
 
-    craw->current = next;
+    f = take_next_frame (craw);
+
+    if (policy == DC1394_CAPTURE_POLICY_LATEST)
+        capture_account_skipped (craw->camera, &f->frame, skipped);
 
     *frame_return = &f->frame;
 
-    if (f->status == BUFFER_ERROR)
+    if (frame_status (f) == BUFFER_ERROR)
         return DC1394_FAILURE;
 
     return DC1394_SUCCESS;
@@ -363,27 +802,25 @@ dc1394_usb_capture_enqueue (platform_camera_t * craw,
         return DC1394_INVALID_ARGUMENT_VALUE;
     }
 
-    if (f->status == BUFFER_EMPTY) {
-        dc1394_log_error ("usb: Frame is not enqueuable");
-        return DC1394_FAILURE;
-    }
+    // a retained frame goes back with dc1394_capture_release()
+    if (f->leased)
+        return DC1394_SUCCESS;
 
-    f->status = BUFFER_EMPTY;
-    if (libusb_submit_transfer (f->transfer) != LIBUSB_SUCCESS) {
-        craw->queue_broken = 1;
+    if (frame_status (f) == BUFFER_EMPTY) {
+        dc1394_log_error ("usb: Frame is not enqueuable");
         return DC1394_FAILURE;
     }
 
-    return DC1394_SUCCESS;
+    return submit_frame (craw, f);
 }
 
 int
 dc1394_usb_capture_get_fileno (platform_camera_t * craw)
 {
-    if (craw->notify_pipe[0] == 0 && craw->notify_pipe[1] == 0)
+    if (craw->notify_fd[0] == 0)
         return -1;
 
-    return craw->notify_pipe[0];
+    return craw->notify_fd[0];
 }
 
 dc1394bool_t
@@ -392,9 +829,49 @@ dc1394_usb_capture_is_frame_corrupt (platform_camera_t * craw,
 {
     struct usb_frame * f = (struct usb_frame *) frame;
 
-    if (f->status == BUFFER_CORRUPT || f->status == BUFFER_ERROR)
+    usb_frame_status status = frame_status (f);
+
+    if (status == BUFFER_CORRUPT || status == BUFFER_ERROR)
         return DC1394_TRUE;
 
     return DC1394_FALSE;
 }
 
+
+dc1394error_t
+dc1394_usb_capture_retain (platform_camera_t * craw,
+        dc1394video_frame_t * frame)
+{
+    struct usb_frame * f = (struct usb_frame *) frame;
+    struct usb_frame * s;
+
+    if (frame->camera != craw->camera || f->leased
+            || frame_status (f) == BUFFER_EMPTY)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+
+    if (craw->spare_count == 0)
+        return DC1394_CAPTURE_NO_SPARE_BUFFER;
+
+    s = craw->frames + craw->spare[--craw->spare_count];
+    if (submit_frame (craw, s) != DC1394_SUCCESS) {
+        craw->spare_count++;
+        return DC1394_FAILURE;
+    }
+
+    f->leased = 1;
+    return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_usb_capture_release (platform_camera_t * craw,
+        dc1394video_frame_t * frame)
+{
+    struct usb_frame * f = (struct usb_frame *) frame;
+
+    if (frame->camera != craw->camera || !f->leased)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+
+    f->leased = 0;
+    craw->spare[craw->spare_count++] = frame->id;
+    return DC1394_SUCCESS;
+}
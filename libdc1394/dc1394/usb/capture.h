@@ -0,0 +1,44 @@
+/*
+ * 1394-Based Digital Camera Control Library
+ *
+ * Camera Capture headers for IIDC-over-USB
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __DC1394_CAPTURE_USB_H__
+#define __DC1394_CAPTURE_USB_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Setup the capture of a USB camera into num_buffers buffers owned by the caller, each at least buffer_size bytes
+   and at least the total_bytes of a frame. The transfers are submitted straight into the buffers, which must stay
+   valid until dc1394_capture_stop(). If a reserve was set with dc1394_capture_set_reserve(), the last buffers of
+   the array are kept as spares. */
+dc1394error_t dc1394_usb_capture_setup_user_buffers(dc1394camera_t *camera, unsigned char **buffers,
+                                                    uint32_t num_buffers, uint64_t buffer_size, uint32_t flags);
+
+/* Set the number of bulk transfers each frame is split into by the next capture setup. All of them are kept in
+   flight, and a frame is complete when its last chunk has arrived. The chunks are rounded to whole USB packets.
+   0 or 1 capture each frame with a single transfer. */
+dc1394error_t dc1394_usb_capture_set_chunks(dc1394camera_t *camera, uint32_t num_chunks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
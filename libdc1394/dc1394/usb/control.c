@@ -40,11 +40,13 @@ dc1394_usb_new (void)
 
     platform_t * p = calloc (1, sizeof (platform_t));
     p->context = context;
+    pthread_mutex_init (&p->lock, NULL);
     return p;
 }
 static void
 dc1394_usb_free (platform_t * p)
 {
+    pthread_mutex_destroy (&p->lock);
     if (p->context)
         libusb_exit(p->context);
     p->context = NULL;
@@ -271,6 +273,7 @@ dc1394_usb_camera_new (platform_t * p, platform_device_t * device,
 
     camera = calloc (1, sizeof (platform_camera_t));
     camera->handle = handle;
+    camera->platform = p;
     return camera;
 }
 
@@ -377,6 +380,9 @@ usb_dispatch = {
     .capture_enqueue = dc1394_usb_capture_enqueue,
     .capture_get_fileno = dc1394_usb_capture_get_fileno,
     .capture_is_frame_corrupt = dc1394_usb_capture_is_frame_corrupt,
+    .capture_retain = dc1394_usb_capture_retain,
+    .capture_release = dc1394_usb_capture_release,
+    .capture_grow = dc1394_usb_capture_grow,
 };
 
 void
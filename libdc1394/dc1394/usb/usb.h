@@ -24,6 +24,7 @@
 #define __DC1394_USB_H__
 
 #include <libusb.h>
+#include <pthread.h>
 #include "config.h"
 #include "internal.h"
 #include "register.h"
@@ -31,31 +32,44 @@
 
 struct _platform_t {
     libusb_context *context;
+
+    /* event thread shared by all the capturing cameras */
+    pthread_mutex_t lock;
+    pthread_t thread;
+    int thread_users;
+    int kill_thread;
 };
 
 struct _platform_camera_t {
     libusb_device_handle * handle;
     dc1394camera_t * camera;
+    platform_t * platform;
 
     struct usb_frame        * frames;
     unsigned char        * buffer;
     size_t buffer_size;
     uint32_t flags;
     unsigned int num_frames;
-    int current;
+    unsigned int max_frames;    /* room in frames, queue and spare to grow into */
+    unsigned int num_dma_buffers;
+    uint32_t chunk_size;
+    int *queue;                 /* frames submitted to libusb, oldest first */
+    unsigned int queue_head, queue_count;
+    int *spare;                 /* frames that can replace a retained frame */
+    unsigned int spare_count;
     int frames_ready;
     int queue_broken;
 
     uint8_t bus;
     uint8_t addr;
-    int notify_pipe[2];
-    pthread_t thread;
-    int thread_created;
-    pthread_mutex_t mutex;
-    int mutex_created;
-    libusb_context *thread_context;
-    libusb_device_handle *thread_handle;
-    int kill_thread;
+    int notify_fd[2];           /* read and write ends, the same eventfd if available */
+    int in_flight;              /* transfers submitted and not yet called back */
+    uint32_t num_chunks;        /* bulk transfers per frame requested by the user */
+    uint32_t frame_chunks;      /* bulk transfers per frame in use */
+    uint32_t bus_bytes_per_msec;    /* bulk rate of the bus, to time single-chunk frames */
+    int idle;                   /* set when in_flight drops to zero, use atomics */
+    int thread_used;
+    int interface_claimed;
 
     int capture_is_set;
     int iso_auto_started;
@@ -68,11 +82,24 @@ typedef enum {
     BUFFER_ERROR,
 } usb_frame_status;
 
+#define CHUNK_SHORT      0x1
+#define CHUNK_FAILED     0x2
+#define CHUNK_CANCELLED  0x4   /* the chunks after a short or failed one were cancelled */
+
 struct usb_frame {
     dc1394video_frame_t frame;
-    struct libusb_transfer * transfer;
+    struct libusb_transfer ** transfers;    /* one per chunk of the frame */
     platform_camera_t * pcam;
-    usb_frame_status status;
+    usb_frame_status status;    /* written by the event thread, use atomics */
+    int chunks_left;            /* chunks still in flight */
+    int chunk_flags;            /* CHUNK_* flags seen on the chunks */
+    uint64_t submit_time;       /* unix time [usec] the frame was queued */
+    uint64_t first_time;        /* monotonic time [usec] of the first chunk */
+    uint32_t first_bytes;       /* bytes received with the first chunk */
+    uint32_t received_bytes;    /* bytes received with all chunks so far */
+    uint64_t frame_time;        /* unix time [usec] the frame started to arrive */
+    int own_image;              /* image allocated on its own when the ring grew */
+    int leased;
 };
 
 
@@ -98,4 +125,14 @@ dc1394bool_t
 dc1394_usb_capture_is_frame_corrupt (platform_camera_t * craw,
         dc1394video_frame_t * frame);
 
+dc1394error_t
+dc1394_usb_capture_retain (platform_camera_t * craw,
+        dc1394video_frame_t * frame);
+
+dc1394error_t
+dc1394_usb_capture_grow (platform_camera_t * craw, uint32_t num_dma_buffers);
+dc1394error_t
+dc1394_usb_capture_release (platform_camera_t * craw,
+        dc1394video_frame_t * frame);
+
 #endif
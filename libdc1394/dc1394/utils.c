@@ -87,7 +87,8 @@ const char *dc1394_error_strings[DC1394_ERROR_NUM] = {
     "Invalid stereo method",
     "Basler error: no more SFF chunks",
     "Basler error: corrupted SFF chunk",
-    "Basler error: unknown SFF chunk"
+    "Basler error: unknown SFF chunk",
+    "No spare capture buffer left to retain a frame"
 };
 
 dc1394error_t
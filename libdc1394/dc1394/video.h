@@ -133,6 +133,14 @@ typedef struct __dc1394_video_frame
                                                        DC1394_FALSE otherwise */
     dc1394bool_t             data_in_padding;       /* DC1394_TRUE if data is present in the padding bytes in IIDC 1.32 format,
                                                        DC1394_FALSE otherwise */
+    uint32_t                 packets_lost;          /* the number of packets of this frame that were missing or truncated
+                                                       on the bus. Only counted on platforms that check packet headers. */
+    uint64_t                 sequence;              /* the number of the frame since the capture was set up. Frames that were
+                                                       dropped, lost to a ring overrun or skipped leave a gap in the sequence */
+    uint32_t                 frames_skipped;        /* the number of older frames given back to the ring buffer unseen when
+                                                       this frame was dequeued with DC1394_CAPTURE_POLICY_LATEST */
+    uint32_t                 rows_available;        /* the number of image lines received so far. Equal to size[1] unless the
+                                                       frame was dequeued early with partial delivery enabled */
 } dc1394video_frame_t;
 
 #ifdef __cplusplus
@@ -213,6 +221,16 @@ dc1394error_t dc1394_video_get_data_depth(dc1394camera_t *camera, uint32_t *dept
  */
 dc1394error_t dc1394_video_set_transmission(dc1394camera_t *camera, dc1394switch_t pwr);
 
+/**
+ * Starts/stops the transmission of several cameras at once. When all the cameras are identical and on the same bus, a single
+ * broadcast write switches them together (it also reaches the other cameras of that bus); the cameras that do not follow
+ * it, or all of them otherwise, are written to with all the requests in flight at once on Juju, back to back on the
+ * other platforms. If skews is not NULL, it receives for each camera the delay [microseconds] between the first camera
+ * switched and the completion of the write that switched it.
+ */
+dc1394error_t dc1394_video_set_transmission_group(dc1394camera_t **cameras, uint32_t num_cameras, dc1394switch_t pwr,
+                                                  uint32_t *skews);
+
 /**
  * Gets the status of the video transmission
  */
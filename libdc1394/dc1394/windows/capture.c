@@ -387,6 +387,8 @@ dc1394_windows_capture_dequeue (platform_camera_t * craw,
     case DC1394_CAPTURE_POLICY_POLL:
         ready=GetOverlappedResult(craw->device_acquisition, pOverlapped, &dwBytesRet, FALSE);
         break;
+    default:
+        return DC1394_INVALID_CAPTURE_POLICY;
     }
 
     if (ready) {
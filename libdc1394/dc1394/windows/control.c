@@ -84,41 +84,63 @@ dc1394_windows_free (platform_t * p)
     free (p);
 }
 
+/* camera is NULL while the devices are enumerated */
 static int
-read_retry (const char * device_path, ULONG offset, PULONG data)
+read_retry (dc1394camera_t * camera, const char * device_path, ULONG offset,
+        PULONG data)
 {
-    int retry = DC1394_MAX_RETRIES;
-    while (retry > 0) {
+    transaction_retry_t retry;
+    uint32_t rcode;
+    int wait;
+
+    transaction_retry_start (camera, &retry, DC1394_MAX_RETRIES);
+    for (;;) {
         DWORD ret = ReadRegisterUL ((char *)device_path, offset, data);
         if (ret == ERROR_SUCCESS) {
+            transaction_account (camera, &retry, 0, DC1394_SUCCESS);
             return 0;
         }
 
-        if (ret != ERROR_SEM_TIMEOUT && ret != ERROR_BUSY) {
+        rcode = ret == ERROR_BUSY ? TRANSACTION_RCODE_BUSY :
+            TRANSACTION_RCODE_UNKNOWN;
+        if (ret != ERROR_SEM_TIMEOUT && ret != ERROR_BUSY)
             break;
-        }
-        usleep (DC1394_SLOW_DOWN);
-        retry--;
+        wait = transaction_retry_next (&retry, rcode);
+        if (wait < 0)
+            break;
+        usleep (wait);
     }
+    transaction_account (camera, &retry, rcode, DC1394_FAILURE);
     return -1;
 }
 
+/* camera is NULL while the devices are enumerated */
 static int
-write_retry (const char * device_path, ULONG offset, ULONG data)
+write_retry (dc1394camera_t * camera, const char * device_path, ULONG offset,
+        ULONG data)
 {
-    int retry = DC1394_MAX_RETRIES;
-    while (retry > 0) {
+    transaction_retry_t retry;
+    uint32_t rcode;
+    int wait;
+
+    transaction_retry_start (camera, &retry, DC1394_MAX_RETRIES);
+    for (;;) {
         DWORD ret = WriteRegisterUL ((char *)device_path, offset, data);
         if (ret == ERROR_SUCCESS) {
+            transaction_account (camera, &retry, 0, DC1394_SUCCESS);
             return 0;
         }
 
-        if (ret != ERROR_SEM_TIMEOUT && ret != ERROR_BUSY) {
+        rcode = ret == ERROR_BUSY ? TRANSACTION_RCODE_BUSY :
+            TRANSACTION_RCODE_UNKNOWN;
+        if (ret != ERROR_SEM_TIMEOUT && ret != ERROR_BUSY)
             break;
-        }
-        usleep (DC1394_SLOW_DOWN);
-        retry--;
+        wait = transaction_retry_next (&retry, rcode);
+        if (wait < 0)
+            break;
+        usleep (wait);
     }
+    transaction_account (camera, &retry, rcode, DC1394_FAILURE);
     return -1;
 }
 
@@ -171,7 +193,7 @@ dc1394_windows_get_device_list (platform_t * p)
             break;
         }
 
-        if (read_retry (device_path, 0xf0000400, &quad) < 0) {
+        if (read_retry (NULL, device_path, 0xf0000400, &quad) < 0) {
             break;
         }
 
@@ -184,7 +206,7 @@ dc1394_windows_get_device_list (platform_t * p)
         device->node = i;
         device->config_rom[0] = quad;
         for (j = 1; j < CONFIG_ROM_SIZE; ++j) {
-            if (read_retry (device_path, 0xf0000400 + 4*j, &quad) < 0) {
+            if (read_retry (NULL, device_path, 0xf0000400 + 4*j, &quad) < 0) {
                 break;
             }
             device->config_rom[j] = quad;
@@ -277,7 +299,7 @@ dc1394_windows_camera_read (platform_camera_t * cam, uint64_t offset,
     int i;
 
     for (i = 0; i < num_quads; ++i) {
-        if (read_retry (cam->device->device_path,
+        if (read_retry (cam->camera, cam->device->device_path,
                         0xf0000000 + offset + 4*i, (PULONG)&quads[i]) < 0) {
             return DC1394_FAILURE;
         }
@@ -293,7 +315,7 @@ dc1394_windows_camera_write (platform_camera_t * cam, uint64_t offset,
     int i;
 
     for (i = 0; i < num_quads; ++i) {
-        if (write_retry (cam->device->device_path,
+        if (write_retry (cam->camera, cam->device->device_path,
                          0xf0000000 + offset + 4*i, quads[i]) < 0) {
             return DC1394_FAILURE;
         }